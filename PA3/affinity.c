@@ -0,0 +1,311 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <dirent.h>
+#include <assert.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "types.h"
+#include "affinity.h"
+
+/* Where each CPU that we may run on sits, read from sysfs */
+struct cpu_topology {
+	int cpu;
+	int package;		/* Socket */
+	int core;
+	int node;		/* NUMA node */
+	int sibling;		/* Index among the SMT siblings of the core */
+};
+
+static struct cpu_topology cpus[CPU_SETSIZE];
+static int nr_cpus = 0;
+
+static enum placement_types placement = placement_none;
+static int generator_cpus[CPU_SETSIZE];
+static int nr_generator_cpus = 0;
+static int counter_cpus[CPU_SETSIZE];
+static int nr_counter_cpus = 0;
+
+static const char * const __placement_names[] = {
+	[placement_none] = "none",
+	[placement_smt] = "smt",
+	[placement_socket] = "socket",
+	[placement_cross] = "cross",
+};
+
+int parse_placement(const char *name)
+{
+	for (int i = 0; i < sizeof(__placement_names) / sizeof(*__placement_names); i++) {
+		if (strcmp(name, __placement_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
+static int __read_topology(int cpu, const char *name)
+{
+	char path[128];
+	FILE *fp;
+	int value = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+	if (!(fp = fopen(path, "r"))) return 0;
+	if (fscanf(fp, "%d", &value) != 1) value = 0;
+	fclose(fp);
+	return value;
+}
+
+/* sysfs links cpuN/nodeM to the node the CPU belongs to */
+static int __read_node(int cpu)
+{
+	char path[128];
+	struct dirent *d;
+	DIR *dir;
+	int node = 0;
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	if (!(dir = opendir(path))) return 0;
+	while ((d = readdir(dir))) {
+		if (sscanf(d->d_name, "node%d", &node) == 1) break;
+	}
+	closedir(dir);
+	return node;
+}
+
+static void __scan_cpus(void)
+{
+	cpu_set_t allowed;
+
+	CPU_ZERO(&allowed);
+	sched_getaffinity(0, sizeof(allowed), &allowed);
+
+	for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		struct cpu_topology *t = cpus + nr_cpus;
+
+		if (!CPU_ISSET(cpu, &allowed)) continue;
+
+		t->cpu = cpu;
+		t->package = __read_topology(cpu, "physical_package_id");
+		t->core = __read_topology(cpu, "core_id");
+		t->node = __read_node(cpu);
+		t->sibling = 0;
+		for (int i = 0; i < nr_cpus; i++) {
+			if (cpus[i].package == t->package && cpus[i].core == t->core) {
+				t->sibling++;
+			}
+		}
+		nr_cpus++;
+	}
+}
+
+/* Find the @sibling-th SMT sibling of @t, or NULL */
+static struct cpu_topology *__find_sibling(struct cpu_topology *t, int sibling)
+{
+	for (int i = 0; i < nr_cpus; i++) {
+		if (cpus[i].package == t->package && cpus[i].core == t->core &&
+				cpus[i].sibling == sibling) {
+			return cpus + i;
+		}
+	}
+	return NULL;
+}
+
+/* Collect the first SMT thread of each core on @package into @list */
+static int __collect_cores(int package, int *list)
+{
+	int nr = 0;
+
+	for (int i = 0; i < nr_cpus; i++) {
+		if (cpus[i].package == package && cpus[i].sibling == 0) {
+			list[nr++] = cpus[i].cpu;
+		}
+	}
+	return nr;
+}
+
+static bool __pick_smt(void)
+{
+	for (int i = 0; i < nr_cpus; i++) {
+		struct cpu_topology *sibling;
+
+		if (cpus[i].sibling != 0) continue;
+		if (!(sibling = __find_sibling(cpus + i, 1))) continue;
+
+		generator_cpus[nr_generator_cpus++] = cpus[i].cpu;
+		counter_cpus[nr_counter_cpus++] = sibling->cpu;
+	}
+	return nr_generator_cpus > 0;
+}
+
+static bool __pick_socket(void)
+{
+	int cores[CPU_SETSIZE];
+	int nr = __collect_cores(cpus[0].package, cores);
+	int half = (nr + 1) / 2;
+
+	if (nr == 1) {		/* Nothing to split; share the only core */
+		generator_cpus[nr_generator_cpus++] = cores[0];
+		counter_cpus[nr_counter_cpus++] = cores[0];
+		return true;
+	}
+	for (int i = 0; i < nr; i++) {
+		if (i < half) {
+			generator_cpus[nr_generator_cpus++] = cores[i];
+		} else {
+			counter_cpus[nr_counter_cpus++] = cores[i];
+		}
+	}
+	return true;
+}
+
+static bool __pick_cross(void)
+{
+	for (int i = 0; i < nr_cpus; i++) {
+		if (cpus[i].package == cpus[0].package) continue;
+
+		nr_generator_cpus = __collect_cores(cpus[0].package, generator_cpus);
+		nr_counter_cpus = __collect_cores(cpus[i].package, counter_cpus);
+		return true;
+	}
+	return false;
+}
+
+static void __print_cpus(const char *name, int *list, int nr)
+{
+	fprintf(stderr, "%s CPU", name);
+	for (int i = 0; i < nr; i++) {
+		fprintf(stderr, "%s%d", i ? "," : " ", list[i]);
+	}
+}
+
+/*********************************************************************
+ * init_placement(@type)
+ *
+ * DESCRIPTION
+ *   Choose the CPUs for generators and counters according to @type. Fall
+ *   back to placement_socket when the machine has no SMT siblings or no
+ *   second socket to honor @type.
+ *
+ * RETURN
+ *   0 on success. Non-zero if the topology cannot be read.
+ */
+int init_placement(const enum placement_types type)
+{
+	bool found = true;
+
+	placement = type;
+	if (placement == placement_none) return 0;
+
+	__scan_cpus();
+	if (!nr_cpus) return -EINVAL;
+
+	if (placement == placement_smt) {
+		found = __pick_smt();
+	} else if (placement == placement_cross) {
+		found = __pick_cross();
+	}
+	if (!found) {
+		fprintf(stderr, "No CPUs for %s placement; use socket placement instead\n",
+				__placement_names[placement]);
+		placement = placement_socket;
+	}
+	if (placement == placement_socket) {
+		__pick_socket();
+	}
+
+	fprintf(stderr, "         Placement : %s, ", __placement_names[placement]);
+	__print_cpus("generators on", generator_cpus, nr_generator_cpus);
+	__print_cpus(", counters on", counter_cpus, nr_counter_cpus);
+	fprintf(stderr, "\n");
+	return 0;
+}
+
+static void __place(pthread_attr_t *attr, int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	pthread_attr_setaffinity_np(attr, sizeof(set), &set);
+}
+
+/*
+ * Spread generators and counters round-robin over their CPUs. Set it in
+ * @attr before pthread_create() so the thread never runs elsewhere.
+ */
+void place_generator(pthread_attr_t *attr, int id)
+{
+	if (placement == placement_none) return;
+	__place(attr, generator_cpus[id % nr_generator_cpus]);
+}
+
+void place_counter(pthread_attr_t *attr, int id)
+{
+	if (placement == placement_none) return;
+	__place(attr, counter_cpus[id % nr_counter_cpus]);
+}
+
+/* Whether alloc_placed() gives the memory pages of its own */
+bool memory_placed(void)
+{
+	return placement != placement_none;
+}
+
+/*********************************************************************
+ * alloc_placed(@len)
+ *
+ * DESCRIPTION
+ *   Allocate @len bytes for the slots of a ring buffer. With a placement,
+ *   the memory gets pages of its own and prefers the NUMA node of the
+ *   first counter, so consumers read the slots from local memory while no
+ *   other heap object is moved along. The preference is best effort;
+ *   kernels without mbind(2) leave the memory where it is, and the kernel
+ *   falls back to other nodes when that one is full. Release it with
+ *   free().
+ *
+ * RETURN
+ *   The memory, or NULL if it cannot be allocated.
+ */
+void *alloc_placed(size_t len)
+{
+	unsigned long page = sysconf(_SC_PAGESIZE);
+	unsigned long nodemask;
+	void *addr;
+	int node = 0;
+
+	if (placement == placement_none) return malloc(len);
+
+	len = (len + page - 1) & ~(page - 1);
+	if (!(addr = aligned_alloc(page, len))) return NULL;
+
+	for (int i = 0; i < nr_cpus; i++) {
+		if (cpus[i].cpu == counter_cpus[0]) node = cpus[i].node;
+	}
+	nodemask = 1UL << node;
+
+	if (syscall(SYS_mbind, addr, len, MPOL_PREFERRED,
+				&nodemask, sizeof(nodemask) * 8, MPOL_MF_MOVE)) {
+		if (verbose) fprintf(stderr, "Cannot place the ring buffer on node %d (%s)\n",
+				node, strerror(errno));
+	}
+	return addr;
+}
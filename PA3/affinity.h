@@ -0,0 +1,35 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+#ifndef __AFFINITY_H__
+#define __AFFINITY_H__
+
+#include <pthread.h>
+
+enum placement_types {
+	placement_none = 0,	/* Let the kernel decide */
+	placement_smt,		/* Generator and counter on SMT siblings of a core */
+	placement_socket,	/* Generators and counters on different cores of a socket */
+	placement_cross,	/* Generators on one socket, counters on another */
+};
+
+int parse_placement(const char *name);
+int init_placement(const enum placement_types);
+void place_generator(pthread_attr_t *attr, int id);
+void place_counter(pthread_attr_t *attr, int id);
+bool memory_placed(void);
+void *alloc_placed(size_t len);
+
+#endif
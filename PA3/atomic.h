@@ -38,4 +38,150 @@ static inline int compare_and_swap(int *value, int old, int new)
 			: "memory" );
 	return old;
 }
+
+/**
+ * Same as compare_and_swap() but on an unsigned long (64-bit) @value.
+ * Return the old value of *@value
+ */
+static inline unsigned long compare_and_swap_ulong(unsigned long *value,
+		unsigned long old, unsigned long new)
+{
+	__asm__ volatile (
+		"lock ; cmpxchgq %3, %1"
+			: "=a"(old), "=m"(*value)
+			: "a"(old), "r"(new)
+			: "memory" );
+	return old;
+}
+
+/**
+ * Atomically add @inc to *@value.
+ * Return the old value of *@value
+ */
+static inline int fetch_and_add(int *value, int inc)
+{
+	__asm__ volatile (
+		"lock ; xaddl %0, %1"
+			: "+r"(inc), "+m"(*value)
+			:
+			: "memory" );
+	return inc;
+}
+
+/**
+ * Atomically set *@value to @new.
+ * Return the old value of *@value
+ */
+static inline int xchg(int *value, int new)
+{
+	__asm__ volatile (
+		"xchgl %0, %1"
+			: "+r"(new), "+m"(*value)
+			:
+			: "memory" );
+	return new;
+}
+
+/**
+ * Pointer flavors of xchg() and compare_and_swap()
+ */
+static inline void *xchg_ptr(void **value, void *new)
+{
+	__asm__ volatile (
+		"xchgq %0, %1"
+			: "+r"(new), "+m"(*value)
+			:
+			: "memory" );
+	return new;
+}
+
+static inline void *compare_and_swap_ptr(void **value, void *old, void *new)
+{
+	return (void *)compare_and_swap_ulong((unsigned long *)value,
+			(unsigned long)old, (unsigned long)new);
+}
+
+/**
+ * Atomically add @inc to *@value.
+ * Return the old value of *@value
+ */
+static inline unsigned long fetch_and_add_ulong(unsigned long *value, unsigned long inc)
+{
+	__asm__ volatile (
+		"lock ; xaddq %0, %1"
+			: "+r"(inc), "+m"(*value)
+			: : "memory" );
+	return inc;
+}
+
+/**
+ * Restricted transactional memory (Intel TSX). Only use them after
+ * checking CPUID; they raise #UD on CPUs without RTM.
+ *
+ * xbegin() returns XBEGIN_STARTED when the transaction starts. When it
+ * aborts, execution resumes from xbegin() again, returning the abort
+ * status instead.
+ */
+#define XBEGIN_STARTED		(~0u)
+#define XABORT_EXPLICIT		(1 << 0)	/* xabort() was called */
+#define XABORT_RETRY		(1 << 1)	/* May succeed on retry */
+#define XABORT_CONFLICT		(1 << 2)	/* Another CPU touched our data */
+#define XABORT_CAPACITY		(1 << 3)	/* Too much data touched */
+#define XABORT_CODE(status)	(((status) >> 24) & 0xff)
+
+static inline unsigned int xbegin(void)
+{
+	unsigned int status = XBEGIN_STARTED;
+
+	__asm__ volatile (".byte 0xc7,0xf8 ; .long 0" : "+a"(status) :: "memory");
+	return status;
+}
+
+static inline void xend(void)
+{
+	__asm__ volatile (".byte 0x0f,0x01,0xd5" ::: "memory");
+}
+
+#define xabort(code) \
+	__asm__ volatile (".byte 0xc6,0xf8,%P0" :: "i"(code) : "memory")
+
+/**
+ * Prevent the compiler from reordering memory accesses across this point.
+ * x86 does not reorder loads with loads nor stores with stores, so this is
+ * enough to get acquire/release ordering below.
+ */
+#define barrier() __asm__ volatile ("" ::: "memory")
+
+/**
+ * Full memory barrier; orders earlier stores against later loads, which
+ * x86 does not do on its own
+ */
+#define smp_mb() __asm__ volatile ("mfence" ::: "memory")
+
+#define READ_ONCE(x)		(*(volatile __typeof__(x) *)&(x))
+#define WRITE_ONCE(x, val)	(*(volatile __typeof__(x) *)&(x) = (val))
+
+#define smp_load_acquire(p) \
+	({ __typeof__(*(p)) ___v = READ_ONCE(*(p)); barrier(); ___v; })
+#define smp_store_release(p, v) \
+	do { barrier(); WRITE_ONCE(*(p), (v)); } while (0)
+
+/**
+ * Read the time-stamp counter. Cheap, but not serializing
+ */
+static inline unsigned long rdtsc(void)
+{
+	unsigned int lo, hi;
+
+	__asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+	return ((unsigned long)hi << 32) | lo;
+}
+
+/**
+ * Tell the CPU that we are in a spin-wait loop
+ */
+static inline void cpu_relax(void)
+{
+	__asm__ volatile ("pause" ::: "memory");
+}
 #endif
@@ -14,59 +14,144 @@
  **********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <pthread.h>
 #include <assert.h>
 
 #include "types.h"
 #include "counter.h"
-
-static pthread_t counter_thread = 0;
-
-static unsigned long nr_requests = 0;
-static unsigned long value_counter[MAX_VALUE] = { 0 };
-
+#include "affinity.h"
+#include "histogram.h"
+
+/*
+ * Each counter counts into its own histogram, padded to cache lines.
+ * @value_counter[i] counts value min_value + i.
+ */
+struct counter {
+	pthread_t thread;
+	int id;
+	unsigned long nr_requests;
+	unsigned long *value_counter;
+} __cacheline_aligned;
+static struct counter *counters = NULL;
+
+int nr_counters = 1;
 int counter_delay_usec = 0;
 
 int __dequeue_rb(void);
+const void *__peek_rb(int max, int *nr);
+void __release_rb(void);
 
 void *counter_main(void *_args_)
 {
-	if (verbose) printf("Counting %lu requests...\n", nr_requests);
+	struct counter *my = (struct counter *)_args_;
+	unsigned long nr_requests = my->nr_requests;
+
+	if (verbose) printf("Counter %d counting %lu requests...\n", my->id, nr_requests);
 
 	for (unsigned long i = 0; i < nr_requests; i++) {
 		/* Take out a value from the ring buffer */
 		int value = __dequeue_rb();
 
 		/* Count it */
-		value_counter[value]++;
+		my->value_counter[value - min_value]++;
 
 		if (counter_delay_usec) usleep(counter_delay_usec);
 
-		if (verbose && i && i % (nr_requests >> 4) == 0) {
-			printf("Counter counted %lu / %lu (%lu%%)\n",
-					i, nr_requests, i * 100 / nr_requests);
+		if (verbose && i && (nr_requests >> 4) && i % (nr_requests >> 4) == 0) {
+			printf("Counter %d counted %lu / %lu (%lu%%)\n",
+					my->id, i, nr_requests, i * 100 / nr_requests);
 		}
 	}
 
-	if (verbose) printf("Counting finished...\n");
+	if (verbose) printf("Counter %d finished...\n", my->id);
 
 	return 0;
 }
 
-int spawn_counter(const enum counter_types type, const unsigned long _nr_requests_)
+/*
+ * Same as counter_main() but counts up to @batch_size records in place.
+ * The value is at the start of each record.
+ */
+void *counter_batch_main(void *_args_)
 {
-	nr_requests = _nr_requests_;
+	struct counter *my = (struct counter *)_args_;
+	unsigned long nr_requests = my->nr_requests;
+	unsigned long step = nr_requests >> 4;
+
+	if (verbose) printf("Counter %d counting %lu requests in batch of %d...\n",
+			my->id, nr_requests, batch_size);
+
+	for (unsigned long i = 0; i < nr_requests; ) {
+		int max = nr_requests - i < batch_size ? nr_requests - i : batch_size;
+		int nr;
+		const char *records = __peek_rb(max, &nr);
+
+		for (int j = 0; j < nr; j++) {
+			int value = *(const int *)(records + (size_t)record_size * j);
+
+			my->value_counter[value - min_value]++;
+		}
+		__release_rb();
+
+		if (counter_delay_usec) usleep(counter_delay_usec * nr);
 
-	pthread_create(&counter_thread, NULL, counter_main, NULL);
+		if (verbose && step && i / step != (i + nr) / step) {
+			printf("Counter %d counted %lu / %lu (%lu%%)\n",
+					my->id, i + nr, nr_requests, (i + nr) * 100 / nr_requests);
+		}
+		i += nr;
+	}
+
+	if (verbose) printf("Counter %d finished...\n", my->id);
+
+	return 0;
+}
+
+int spawn_counter(const enum counter_types type, const unsigned long nr_requests)
+{
+	pthread_attr_t attr;
+
+	assert(nr_counters > 0);
+
+	counters = aligned_alloc(CACHELINE_SIZE, sizeof(*counters) * nr_counters);
+	if (!counters) return -ENOMEM;
+	bzero(counters, sizeof(*counters) * nr_counters);
+
+	for (int i = 0; i < nr_counters; i++) {
+		struct counter *c = counters + i;
+		c->id = i;
+		c->value_counter = alloc_histogram(max_value - min_value);
+		if (!c->value_counter) return -ENOMEM;
+		/*
+		 * Split the requests in whole batches; the first ones take the
+		 * remaining batches, and the first one the partial batch
+		 */
+		c->nr_requests = (nr_requests / batch_size / nr_counters +
+				(i < nr_requests / batch_size % nr_counters ? 1 : 0)) * batch_size +
+				(i == 0 ? nr_requests % batch_size : 0);
+		pthread_attr_init(&attr);
+		place_counter(&attr, i);
+		pthread_create(&c->thread, &attr,
+				type == counter_batched ? counter_batch_main : counter_main, c);
+		pthread_attr_destroy(&attr);
+	}
 	return 0;
 }
 
 void fini_counter(unsigned long values[])
 {
-	if (counter_thread) {
-		pthread_join(counter_thread, NULL);
-		memcpy(values, value_counter, sizeof(unsigned long) * MAX_VALUE);
+	if (!counters) return;
+
+	for (int i = 0; i < nr_counters; i++) {
+		struct counter *c = counters + i;
+		pthread_join(c->thread, NULL);
+		histogram_add(values, c->value_counter, max_value - min_value);
+		free(c->value_counter);
 	}
+	free(counters);
+	counters = NULL;
 }
@@ -19,6 +19,7 @@
 enum counter_types {
 	counter_normal = 0,
 	counter_delayed,
+	counter_batched,
 };
 
 int spawn_counter(const enum counter_types, const unsigned long);
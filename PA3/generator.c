@@ -20,25 +20,115 @@
 #include <errno.h>
 #include <pthread.h>
 #include <assert.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "types.h"
+#include "locks.h"
 #include "generator.h"
+#include "affinity.h"
+#include "histogram.h"
 
 /* Barrier to synchronize generators */
-static pthread_barrier_t barrier;
+static struct barrier barrier;
 
 int generator_delay_usec = 0;
+bool generator_accumulate = false;
 
 /* Assorted generator functions */
 int generator_fn_constant(int id)
 {
-	return 43;
+	return 43 >= min_value && 43 < max_value ? 43 : min_value;
 }
 
 int generator_fn_random(int id)
 {
 	if (generator_delay_usec) usleep(generator_delay_usec);
-	return MIN_VALUE + (random() % (MAX_VALUE - MIN_VALUE));
+	return min_value + (random() % (max_value - min_value));
+}
+
+/*
+ * xorshift32 with four independent lanes per thread, so the bulk fill can
+ * step them together in one SSE2 register. The lanes are seeded from the
+ * generator id with splitmix64, and no state is shared between threads.
+ */
+struct xorshift {
+	unsigned int lane[4];
+	int next;		/* Next lane for generator_fn_xorshift() */
+	bool seeded;
+};
+static __thread struct xorshift xorshift;
+
+static void __seed_xorshift(int id)
+{
+	unsigned long z = (unsigned long)id * 0x9e3779b97f4a7c15UL;
+
+	for (int i = 0; i < 4; i++) {
+		unsigned long x = (z += 0x9e3779b97f4a7c15UL);
+
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9UL;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebUL;
+		x ^= x >> 31;
+		xorshift.lane[i] = (unsigned int)x | 1;	/* Never zero */
+	}
+	xorshift.next = 0;
+	xorshift.seeded = true;
+}
+
+/* Map a 32-bit random number onto [min_value, max_value) without a division */
+static inline int __to_value(unsigned int x)
+{
+	return min_value + (int)(((unsigned long)x * (max_value - min_value)) >> 32);
+}
+
+int generator_fn_xorshift(int id)
+{
+	unsigned int x;
+
+	if (generator_delay_usec) usleep(generator_delay_usec);
+	if (!xorshift.seeded) __seed_xorshift(id);
+
+	x = xorshift.lane[xorshift.next];
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	xorshift.lane[xorshift.next] = x;
+	xorshift.next = (xorshift.next + 1) & 3;
+
+	return __to_value(x);
+}
+
+/* Fill @values with @nr values at once; the lanes advance four at a time */
+void generator_fill_xorshift(int id, int *values, int nr)
+{
+	int i = 0;
+
+	if (generator_delay_usec) usleep(generator_delay_usec * nr);
+	if (!xorshift.seeded) __seed_xorshift(id);
+
+#ifdef __SSE2__
+	{
+		__m128i x = _mm_loadu_si128((__m128i *)xorshift.lane);
+		unsigned int out[4] __attribute__((aligned(16)));
+
+		for (; i + 4 <= nr; i += 4) {
+			x = _mm_xor_si128(x, _mm_slli_epi32(x, 13));
+			x = _mm_xor_si128(x, _mm_srli_epi32(x, 17));
+			x = _mm_xor_si128(x, _mm_slli_epi32(x, 5));
+			_mm_store_si128((__m128i *)out, x);
+
+			values[i + 0] = __to_value(out[0]);
+			values[i + 1] = __to_value(out[1]);
+			values[i + 2] = __to_value(out[2]);
+			values[i + 3] = __to_value(out[3]);
+		}
+		_mm_storeu_si128((__m128i *)xorshift.lane, x);
+	}
+#endif
+	for (; i < nr; i++) {
+		values[i] = generator_fn_xorshift(id);
+	}
 }
 
 int (*assign_generator_fn(int id, enum generator_types type))(int)
@@ -50,6 +140,8 @@ int (*assign_generator_fn(int id, enum generator_types type))(int)
 		return &generator_fn_random;
 	case generator_mixed:
 		return id % 2 == 0 ? &generator_fn_constant : &generator_fn_random;
+	case generator_xorshift:
+		return &generator_fn_xorshift;
 	default:
 		assert(0);
 		break;
@@ -59,23 +151,61 @@ int (*assign_generator_fn(int id, enum generator_types type))(int)
 	assert(0);
 }
 
+/*
+ * Each generator counts into its own histogram. The histogram sits on
+ * cache lines of its own and the struct is padded to cache lines, so
+ * neither the neighbours nor the main thread reading @thread share them.
+ * @generated[i] counts value min_value + i.
+ */
 struct generator {
 	pthread_t thread;
 	int id;
 	int (*generator_fn)(int id);
-	unsigned long generated[MAX_VALUE];
-};
+	unsigned long *generated;
+} __cacheline_aligned;
 static struct generator *generators = NULL;
 
+/*
+ * With -A, a run of equal values is counted in a register and added to
+ * the histogram once the value changes, instead of once per value.
+ */
+struct run {
+	int value;
+	unsigned long nr;
+};
+
+static inline void __account(struct generator *my, struct run *run, int value)
+{
+	if (!generator_accumulate) {
+		my->generated[value - min_value]++;
+		return;
+	}
+	if (value == run->value) {
+		run->nr++;
+		return;
+	}
+	if (run->nr) my->generated[run->value - min_value] += run->nr;
+	run->value = value;
+	run->nr = 1;
+}
+
+static inline void __flush_run(struct generator *my, struct run *run)
+{
+	if (run->nr) my->generated[run->value - min_value] += run->nr;
+	run->nr = 0;
+}
+
 void __enqueue_rb(int value);
+int __enqueue_rb_batch(const void *records, int nr);
 
 void *generator_main(void *_args_)
 {
 	struct generator *my = (struct generator *)_args_;
+	struct run run = { .nr = 0 };
 
 	if (verbose) printf("Generator %d started...\n", my->id);
 
-	pthread_barrier_wait(&barrier); /* 1st barrier */
+	wait_barrier(&barrier, my->id); /* 1st barrier */
 
 	for (unsigned long i = 0; i < nr_generate; i++) {
 		/* Generate a number */
@@ -85,72 +215,145 @@ void *generator_main(void *_args_)
 		__enqueue_rb((int)value);
 		
 		/* Account for the generated value */
-		my->generated[value]++;
+		__account(my, &run, value);
 
 		if (verbose && i && i % (nr_generate >> 4) == 0) {
 			printf("Generator %d generated %lu / %lu (%lu%%)\n",
 					my->id, i, nr_generate, i * 100 / nr_generate);
 		}
 	}
+	__flush_run(my, &run);
+	if (verbose) printf("Generator %d finished...\n", my->id);
+
+	wait_barrier(&barrier, my->id); /* 2nd barrier */
+
+	/* Wait for main thread to collect generated value counts */
+	wait_barrier(&barrier, my->id);	/* 3rd barrier */
+
+	return 0;
+}
+
+/*
+ * Same as generator_main() but puts @batch_size values at once. Values are
+ * turned into records of @record_size bytes unless they are plain ints.
+ */
+void *generator_batch_main(void *_args_)
+{
+	struct generator *my = (struct generator *)_args_;
+	unsigned long step = nr_generate >> 4;
+	int *values = malloc(sizeof(int) * batch_size);
+	char *records = (char *)values;
+	struct run run = { .nr = 0 };
+
+	assert(values);
+	if (record_size != sizeof(int)) {
+		records = malloc((size_t)record_size * batch_size);
+		assert(records);
+	}
+	if (verbose) printf("Generator %d started...\n", my->id);
+
+	wait_barrier(&barrier, my->id); /* 1st barrier */
+
+	for (unsigned long i = 0; i < nr_generate; ) {
+		int nr = nr_generate - i < batch_size ? nr_generate - i : batch_size;
+
+		if (my->generator_fn == generator_fn_xorshift) {
+			generator_fill_xorshift(my->id, values, nr);
+		} else {
+			for (int j = 0; j < nr; j++) {
+				values[j] = my->generator_fn(my->id);
+			}
+		}
+
+		if (records != (char *)values) {
+			for (int j = 0; j < nr; j++) {
+				char *record = records + (size_t)record_size * j;
+
+				*(int *)record = values[j];
+				memset(record + sizeof(int), values[j], record_size - sizeof(int));
+			}
+		}
+
+		for (int done = 0; done < nr; ) {
+			done += __enqueue_rb_batch(records + (size_t)record_size * done, nr - done);
+		}
+
+		for (int j = 0; j < nr; j++) {
+			__account(my, &run, values[j]);
+		}
+
+		if (verbose && step && i / step != (i + nr) / step) {
+			printf("Generator %d generated %lu / %lu (%lu%%)\n",
+					my->id, i + nr, nr_generate, (i + nr) * 100 / nr_generate);
+		}
+		i += nr;
+	}
+	__flush_run(my, &run);
 	if (verbose) printf("Generator %d finished...\n", my->id);
+	if (records != (char *)values) free(records);
+	free(values);
 
-	pthread_barrier_wait(&barrier); /* 2nd barrier */
+	wait_barrier(&barrier, my->id); /* 2nd barrier */
 
 	/* Wait for main thread to collect generated value counts */
-	pthread_barrier_wait(&barrier);	/* 3rd barrier */
+	wait_barrier(&barrier, my->id);	/* 3rd barrier */
 
 	return 0;
 }
 
 int spawn_generators(const enum generator_types type)
 {
+	pthread_attr_t attr;
+
 	assert(nr_generators > 0);
 	assert(nr_generate > 0);
 
-	generators = calloc(nr_generators, sizeof(*generators));
+	generators = aligned_alloc(CACHELINE_SIZE, sizeof(*generators) * nr_generators);
 	assert(generators);
 	bzero(generators, sizeof(*generators) * nr_generators);
 
-	pthread_barrier_init(&barrier, NULL, nr_generators + 1);
+	if (init_barrier(&barrier, barrier_type, nr_generators + 1)) return -ENOMEM;
 
 	for (int i = 0; i < nr_generators; i++) {
 		struct generator *g = generators + i;
 		g->id = i;
 		g->generator_fn = assign_generator_fn(i, type);
-		pthread_create(&g->thread, NULL, generator_main, g);
+		g->generated = alloc_histogram(max_value - min_value);
+		assert(g->generated);
+		pthread_attr_init(&attr);
+		place_generator(&attr, i);
+		pthread_create(&g->thread, &attr,
+				batch_size > 1 || record_size != sizeof(int) ?
+						generator_batch_main : generator_main, g);
+		pthread_attr_destroy(&attr);
 	}
 
-	pthread_barrier_wait(&barrier);	/* 1st barrier */
+	wait_barrier(&barrier, nr_generators);	/* 1st barrier */
 
 	return 0;
 }
 
 void do_generate(void)
 {
-	pthread_barrier_wait(&barrier);	/* 2nd barrier */
+	wait_barrier(&barrier, nr_generators);	/* 2nd barrier */
 }
 
 void fini_generators(unsigned long values[])
 {
 	/* Collect generation result */
 	for (int i = 0; i < nr_generators; i++) {
-		struct generator *g = generators + i;
-		for (int n = MIN_VALUE; n < MAX_VALUE; n++) {
-			values[n] += g->generated[n];
-		}
-	}
-
-	for (int n = MIN_VALUE; n < MAX_VALUE; n++) {
-		if (!values[n]) continue;
+		histogram_add(values, generators[i].generated, max_value - min_value);
 	}
 
-	pthread_barrier_wait(&barrier);	/* 3rd barrier */
+	wait_barrier(&barrier, nr_generators);	/* 3rd barrier */
 
 	for (int i = 0; i < nr_generators; i++) {
 		struct generator *g = generators + i;
 		if ((unsigned long)(g->thread) != 0) {
 			pthread_join(g->thread, NULL);
 		}
+		free(g->generated);
 	}
 	free(generators);
+	fini_barrier(&barrier);
 }
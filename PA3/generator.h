@@ -21,6 +21,7 @@ enum generator_types {
 	generator_random,
 	generator_constant,
 	generator_mixed,
+	generator_xorshift,
 };
 
 int spawn_generators(const enum generator_types);
@@ -0,0 +1,165 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "types.h"
+#include "histogram.h"
+
+/*
+ * The AVX2 kernels are compiled for AVX2 through the target attribute and
+ * are called only when the CPU reports AVX2, so the rest of the program
+ * still runs on any x86-64. SSE2 is part of x86-64 and needs no check.
+ */
+static bool __has_avx2(void)
+{
+	static int has_avx2 = -1;
+
+	if (has_avx2 < 0) {
+		__builtin_cpu_init();
+		has_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+	}
+	return has_avx2;
+}
+
+__attribute__((target("avx2")))
+static int __add_avx2(unsigned long *dst, const unsigned long *src, int nr)
+{
+	int i;
+
+	for (i = 0; i + 4 <= nr; i += 4) {
+		__m256i d = _mm256_loadu_si256((__m256i *)(dst + i));
+		__m256i s = _mm256_loadu_si256((const __m256i *)(src + i));
+
+		_mm256_storeu_si256((__m256i *)(dst + i), _mm256_add_epi64(d, s));
+	}
+	return i;
+}
+
+__attribute__((target("avx2")))
+static int __equal_avx2(const unsigned long *a, const unsigned long *b, int nr, bool *equal)
+{
+	int i;
+
+	for (i = 0; i + 4 <= nr; i += 4) {
+		__m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i *)(b + i));
+
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != -1) {
+			*equal = false;
+			return i;
+		}
+	}
+	return i;
+}
+
+#ifdef __SSE2__
+static int __add_sse2(unsigned long *dst, const unsigned long *src, int nr)
+{
+	int i;
+
+	for (i = 0; i + 2 <= nr; i += 2) {
+		__m128i d = _mm_loadu_si128((__m128i *)(dst + i));
+		__m128i s = _mm_loadu_si128((const __m128i *)(src + i));
+
+		_mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi64(d, s));
+	}
+	return i;
+}
+
+static int __equal_sse2(const unsigned long *a, const unsigned long *b, int nr, bool *equal)
+{
+	int i;
+
+	for (i = 0; i + 2 <= nr; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+			*equal = false;
+			return i;
+		}
+	}
+	return i;
+}
+#endif
+
+/*********************************************************************
+ * alloc_histogram(@nr)
+ *
+ * DESCRIPTION
+ *   Allocate @nr zeroed buckets on cache lines of their own. Free with
+ *   free().
+ */
+unsigned long *alloc_histogram(int nr)
+{
+	size_t size = sizeof(unsigned long) * nr;
+	unsigned long *buckets;
+
+	size = (size + CACHELINE_SIZE - 1) & ~(size_t)(CACHELINE_SIZE - 1);
+	buckets = aligned_alloc(CACHELINE_SIZE, size);
+	if (buckets) memset(buckets, 0, size);
+	return buckets;
+}
+
+/*********************************************************************
+ * histogram_add(@dst, @src, @nr)
+ *
+ * DESCRIPTION
+ *   Add the first @nr buckets of @src into @dst.
+ */
+void histogram_add(unsigned long *dst, const unsigned long *src, int nr)
+{
+	int i = 0;
+
+	if (__has_avx2()) {
+		i = __add_avx2(dst, src, nr);
+	}
+#ifdef __SSE2__
+	i += __add_sse2(dst + i, src + i, nr - i);
+#endif
+	for (; i < nr; i++) {
+		dst[i] += src[i];
+	}
+}
+
+/*********************************************************************
+ * histogram_equal(@a, @b, @nr)
+ *
+ * RETURN
+ *   true if the first @nr buckets of @a and @b are all the same.
+ */
+bool histogram_equal(const unsigned long *a, const unsigned long *b, int nr)
+{
+	bool equal = true;
+	int i = 0;
+
+	if (__has_avx2()) {
+		i = __equal_avx2(a, b, nr, &equal);
+		if (!equal) return false;
+	}
+#ifdef __SSE2__
+	i += __equal_sse2(a + i, b + i, nr - i, &equal);
+	if (!equal) return false;
+#endif
+	for (; i < nr; i++) {
+		if (a[i] != b[i]) return false;
+	}
+	return true;
+}
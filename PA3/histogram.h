@@ -0,0 +1,29 @@
+/**********************************************************************
+ * Copyright (c) 2020
+ *  Sang-Hoon Kim <sanghoonkim@ajou.ac.kr>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTIABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ **********************************************************************/
+
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+/*
+ * Value histograms are arrays of max_value - min_value unsigned longs,
+ * one per value in the range set at runtime. These kernels use AVX2 or
+ * SSE2 when the CPU has them and plain loops otherwise.
+ */
+unsigned long *alloc_histogram(int nr);
+void histogram_add(unsigned long *dst, const unsigned long *src, int nr);
+bool histogram_equal(const unsigned long *a, const unsigned long *b, int nr);
+
+#endif
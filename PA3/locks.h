@@ -16,6 +16,8 @@
 #ifndef __LOCKS_H__
 #define __LOCKS_H__
 
+#include <pthread.h>
+
 /*************************************************
  * Spinlock
  */
@@ -25,6 +27,66 @@ void acquire_spinlock(struct spinlock *);
 void release_spinlock(struct spinlock *);
 
 
+/*************************************************
+ * Ticket spinlock. Waiters are served in FIFO order
+ */
+struct ticketlock;
+void init_ticketlock(struct ticketlock *);
+void acquire_ticketlock(struct ticketlock *);
+void release_ticketlock(struct ticketlock *);
+
+
+/*************************************************
+ * MCS queue spinlock. Waiters are served in FIFO order and
+ * each of them spins on its own cache line. A thread may hold
+ * up to MCS_MAX_NESTING MCS locks at a time and should release
+ * them in the reverse order of acquisition.
+ */
+#define MCS_MAX_NESTING 4
+struct mcslock;
+void init_mcslock(struct mcslock *);
+void acquire_mcslock(struct mcslock *);
+void release_mcslock(struct mcslock *);
+
+
+/*************************************************
+ * Elided spinlock. Critical sections run as hardware (TSX/RTM)
+ * transactions when the CPU supports them, and fall back to the
+ * spinlock after repeated aborts or on CPUs without RTM.
+ */
+struct elision_stats {
+	unsigned long nr_fallback;	/* Acquired the real spinlock */
+	unsigned long nr_busy;		/* Aborted because the lock was held */
+	unsigned long nr_conflict;	/* Aborted on a data conflict */
+	unsigned long nr_capacity;	/* Aborted on too large a footprint */
+	unsigned long nr_other;		/* Aborted for other reasons */
+};
+
+struct elided_spinlock;
+bool elision_supported(void);
+void init_elided_spinlock(struct elided_spinlock *);
+void acquire_elided_spinlock(struct elided_spinlock *);
+void release_elided_spinlock(struct elided_spinlock *);
+void get_elided_spinlock_stats(struct elided_spinlock *, struct elision_stats *);
+
+
+/*************************************************
+ * Yielding spinlock. Spins with exponential backoff for up to
+ * YIELD_SPINLOCK_SPINS pause instructions, then calls sched_yield()
+ * between attempts so that a preempted holder gets the CPU back.
+ */
+struct yield_stats {
+	unsigned long nr_contended;	/* Acquired after spinning */
+	unsigned long nr_yields;	/* Calls to sched_yield() */
+};
+
+struct yield_spinlock;
+void init_yield_spinlock(struct yield_spinlock *);
+void acquire_yield_spinlock(struct yield_spinlock *);
+void release_yield_spinlock(struct yield_spinlock *);
+void get_yield_spinlock_stats(struct yield_spinlock *, struct yield_stats *);
+
+
 /*************************************************
  * Mutex
  */
@@ -33,4 +95,174 @@ void init_mutex(struct mutex *);
 void acquire_mutex(struct mutex *);
 void release_mutex(struct mutex *);
 
+
+/*************************************************
+ * Counting semaphore
+ */
+struct semaphore;
+void init_sem(struct semaphore *, int count);
+void wait_sem(struct semaphore *);
+bool try_wait_sem(struct semaphore *);
+void signal_sem(struct semaphore *);
+
+
+/*************************************************
+ * Adaptive mutex. Spins with backoff for up to @adaptive_mutex_spins
+ * pause instructions before sleeping like a mutex.
+ */
+struct lock_stats {
+	unsigned long nr_fast;		/* Acquired without contention */
+	unsigned long nr_spin;		/* Acquired while spinning */
+	unsigned long nr_parked;	/* Acquired after sleeping */
+	unsigned long wait_ns;		/* Total time spent to acquire */
+};
+
+extern int adaptive_mutex_spins;
+
+struct adaptive_mutex;
+void init_adaptive_mutex(struct adaptive_mutex *);
+void acquire_adaptive_mutex(struct adaptive_mutex *);
+void release_adaptive_mutex(struct adaptive_mutex *);
+void get_adaptive_mutex_stats(struct adaptive_mutex *, struct lock_stats *);
+
+
+/*************************************************
+ * Priority-inheritance mutex. While threads of a higher priority wait,
+ * the holder runs at the highest of their priorities. Priorities go
+ * from 0, a normal thread, to NR_PI_PRIOS - 1 and map to SCHED_FIFO or
+ * nice values, as far as the process is permitted; pi_mode() tells which.
+ * Waiters are served by priority, in FIFO order among equals.
+ */
+#define NR_PI_PRIOS 20
+
+enum pi_modes {
+	pi_simulated = 0,	/* Priorities are only recorded */
+	pi_nice,		/* Priority @prio is nice -@prio */
+	pi_fifo,		/* Priority @prio is SCHED_FIFO @prio */
+};
+
+struct pi_stats {
+	unsigned long nr_contended;	/* Acquired after waiting */
+	unsigned long nr_boosts;	/* Holders raised to a waiter's priority */
+};
+
+enum pi_modes pi_mode(void);
+void set_pi_priority(int prio);
+
+struct pi_mutex;
+void init_pi_mutex(struct pi_mutex *, bool inherit);
+void acquire_pi_mutex(struct pi_mutex *);
+void release_pi_mutex(struct pi_mutex *);
+void get_pi_mutex_stats(struct pi_mutex *, struct pi_stats *);
+
+
+/*************************************************
+ * Reader-writer lock. Readers share the lock; a writer excludes
+ * everyone. Once a writer waits, new readers wait behind it.
+ */
+struct rwlock;
+void init_rwlock(struct rwlock *);
+void acquire_read_rwlock(struct rwlock *);
+void release_read_rwlock(struct rwlock *);
+void acquire_write_rwlock(struct rwlock *);
+void release_write_rwlock(struct rwlock *);
+
+
+/*************************************************
+ * Seqlock. Writers exclude each other with a spinlock; readers never
+ * block writers but retry when a write overlapped their read:
+ *
+ *   do {
+ *     seq = read_seqbegin(lock);
+ *     ... copy the protected data ...
+ *   } while (read_seqretry(lock, seq));
+ */
+struct seqlock;
+void init_seqlock(struct seqlock *);
+void write_seqlock(struct seqlock *);
+void write_sequnlock(struct seqlock *);
+int read_seqbegin(struct seqlock *);
+bool read_seqretry(struct seqlock *, int seq);
+
+
+/*************************************************
+ * Condition variable. It does not know about the lock protecting the
+ * condition, so it works with any of the locks above or with none:
+ *
+ *   lock; while (!condition) {
+ *     ticket = prepare_to_wait_condvar(cv); unlock;
+ *     wait_condvar(cv, ticket); finish_wait_condvar(cv); lock;
+ *   }
+ *
+ * A signal sent after prepare_to_wait_condvar() is never lost.
+ */
+struct condvar {
+	int seq;
+	int nr_waiters;
+};
+void init_condvar(struct condvar *);
+int prepare_to_wait_condvar(struct condvar *);
+void wait_condvar(struct condvar *, int ticket);
+void finish_wait_condvar(struct condvar *);
+void signal_condvar(struct condvar *);
+void broadcast_condvar(struct condvar *);
+
+
+/*************************************************
+ * Barrier. @nr threads, numbered from 0 to @nr - 1, meet at wait_barrier()
+ * over and over; nobody leaves an episode before everyone has arrived.
+ * @barrier_type picks the algorithm for the generators and the tester.
+ */
+enum barrier_types {
+	barrier_pthread = 0,	/* pthread_barrier_t */
+	barrier_central,	/* Sense-reversing counter */
+	barrier_tree,		/* Combining tree for arrival, central release */
+	barrier_dissemination,	/* log2(@nr) rounds of pairwise signals */
+	NR_BARRIER_TYPES,
+};
+
+extern enum barrier_types barrier_type;
+
+struct barrier_node;
+struct barrier_peer;
+
+struct barrier {
+	enum barrier_types type;
+	int nr;
+	int count;			/* Threads yet to arrive, for barrier_central */
+	int episode __cacheline_aligned;	/* Bumped when everyone has arrived */
+	struct condvar release;
+	struct barrier_node *nodes;	/* For barrier_tree */
+	struct barrier_peer *peers;	/* For barrier_dissemination */
+	pthread_barrier_t pthread;
+};
+int init_barrier(struct barrier *, enum barrier_types, int nr);
+void wait_barrier(struct barrier *, int id);
+void fini_barrier(struct barrier *);
+
+
+/*************************************************
+ * Countdown latch. wait_latch() returns once count_down_latch() has been
+ * called as many times as the initial count. It cannot be reused.
+ */
+struct latch {
+	int count;
+	struct condvar done;
+};
+void init_latch(struct latch *, int count);
+void count_down_latch(struct latch *);
+void wait_latch(struct latch *);
+
+
+/*************************************************
+ * Once. The first run_once() on @once calls @fn; the others wait until
+ * it returns and call nothing.
+ */
+struct once {
+	int state;
+	struct condvar done;
+};
+#define ONCE_INIT { 0, { 0, 0 } }
+void run_once(struct once *, void (*fn)(void));
+
 #endif
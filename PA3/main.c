@@ -15,10 +15,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <errno.h>
 #include <pthread.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <assert.h>
 
 #include "types.h"
@@ -26,6 +28,8 @@
 #include "locks.h"
 #include "generator.h"
 #include "counter.h"
+#include "affinity.h"
+#include "histogram.h"
 
 /*************************************************
  * Lock tester.
@@ -33,6 +37,30 @@
  */
 void test_lock(enum lock_types);
 
+/*************************************************
+ * Lock benchmark.
+ * Will be invoked if the program is run with -B
+ */
+void bench_locks(void);
+
+/*************************************************
+ * Barrier benchmark.
+ * Will be invoked if the program is run with -Y
+ */
+void bench_barriers(void);
+
+/*************************************************
+ * Oversubscription benchmark.
+ * Will be invoked if the program is run with -O
+ */
+void bench_oversubscribed(void);
+
+/*************************************************
+ * Priority inversion test.
+ * Will be invoked if the program is run with -I
+ */
+void test_priority_inversion(void);
+
 /* Common */
 int verbose = 1;
 
@@ -44,20 +72,40 @@ unsigned long nr_generate = 128;
 /* Counter */
 static enum counter_types counter_type = counter_normal;
 
+/* Number of values to move at once */
+int batch_size = 1;
+static bool whole_batches = false;	/* Reserve and peek whole batches only */
+
+/* Value range and record size */
+int min_value = MIN_VALUE;
+int max_value = MAX_VALUE;
+int record_size = sizeof(int);
+
 /* Ring buffer */
 static int nr_slots = 64;
+enum lock_types ringbuffer_lock = lock_spinlock;
+int ringbuffer_max_slots = 0;
+
+/* Where to run generators and counters */
+static enum placement_types placement = placement_none;
 
 /*********************************************************************
  * Common implementation
  */
 void enqueue_into_ringbuffer(int value);
 int dequeue_from_ringbuffer(void);
+int enqueue_batch_into_ringbuffer(const void *records, int nr);
+int dequeue_batch_from_ringbuffer(void *records, int max);
+void *reserve_ringbuffer(int min, int nr, int *reserved);
+void commit_ringbuffer(void);
+const void *peek_ringbuffer(int min, int max, int *nr);
+void release_ringbuffer(void);
 void fini_ringbuffer(void);
 int init_ringbuffer(const int nr_slots);
 
 void __enqueue_rb(int value)
 {
-	assert(value >= MIN_VALUE && value < MAX_VALUE);
+	assert(value >= min_value && value < max_value);
 	enqueue_into_ringbuffer(value);
 }
 
@@ -66,11 +114,56 @@ int __dequeue_rb(void)
 	int value;
 
 	value = dequeue_from_ringbuffer();
-	assert(value >= MIN_VALUE && value < MAX_VALUE);
+	assert(value >= min_value && value < max_value);
 
 	return value;
 }
 
+/* The value must be in range, and the payload must end in its low byte */
+static void __check_records(const char *records, int nr)
+{
+	for (int i = 0; i < nr; i++) {
+		const char *record = records + (size_t)record_size * i;
+		int value = *(const int *)record;
+
+		assert(value >= min_value && value < max_value);
+		assert(record_size == sizeof(int) || record[record_size - 1] == (char)value);
+	}
+}
+
+int __enqueue_rb_batch(const void *records, int nr)
+{
+	void *span;
+	int reserved;
+
+	__check_records(records, nr);
+	if (!whole_batches) return enqueue_batch_into_ringbuffer(records, nr);
+
+	/* One run of @nr slots; the ring pads its tail when the run would wrap */
+	span = reserve_ringbuffer(nr, nr, &reserved);
+	assert(reserved == nr);
+	memcpy(span, records, (size_t)record_size * nr);
+	commit_ringbuffer();
+	return nr;
+}
+
+const void *__peek_rb(int max, int *nr)
+{
+	const void *records;
+
+	records = peek_ringbuffer(whole_batches ? max : 1, max, nr);
+	assert(*nr > 0 && *nr <= max);
+	assert(!whole_batches || *nr == max);
+	__check_records(records, *nr);
+
+	return records;
+}
+
+void __release_rb(void)
+{
+	release_ringbuffer();
+}
+
 static int __init_rb(const int _nr_slots_)
 {
 	assert(_nr_slots_ > 0);
@@ -82,6 +175,45 @@ static void __fini_rb(void)
 	fini_ringbuffer();
 }
 
+static const char * const __lock_names[] = {
+	[lock_spinlock] = "spinlock",
+	[lock_mutex] = "mutex",
+	[lock_semaphore] = "semaphore",
+	[lock_lockfree] = "lockfree",
+	[lock_ticket] = "ticket",
+	[lock_mcs] = "mcs",
+	[lock_adaptive] = "adaptive",
+	[lock_sharded] = "sharded",
+	[lock_rwlock] = "rwlock",
+	[lock_seqlock] = "seqlock",
+	[lock_elided] = "elided",
+	[lock_yield] = "yield",
+	[lock_pi] = "pi",
+};
+
+static int __parse_lock_type(const char *name)
+{
+	for (int i = 0; i < sizeof(__lock_names) / sizeof(*__lock_names); i++) {
+		if (__lock_names[i] && strcmp(name, __lock_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
+static const char * const __barrier_names[] = {
+	[barrier_pthread] = "pthread",
+	[barrier_central] = "central",
+	[barrier_tree] = "tree",
+	[barrier_dissemination] = "dissemination",
+};
+
+static int __parse_barrier_type(const char *name)
+{
+	for (int i = 0; i < sizeof(__barrier_names) / sizeof(*__barrier_names); i++) {
+		if (strcmp(name, __barrier_names[i]) == 0) return i;
+	}
+	return -1;
+}
+
 static void __print_usage(const char *argv0)
 {
 	printf("Usage: %s {options}\n", argv0);
@@ -89,16 +221,45 @@ static void __print_usage(const char *argv0)
 	printf(" Run with -l or -m to check the correctness of the lock implementation\n");
 	printf("  -l         : Test spinlock implementation\n");
 	printf("  -m         : Torture blocking mutex\n");
+	printf("  -T [type]  : Test @type lock (spinlock, mutex, ticket, mcs,\n");
+	printf("               adaptive, rwlock, seqlock, semaphore, elided, yield, pi)\n");
+	printf("  -a [number]: Let adaptive mutex spin @number times before sleeping\n");
+	printf("  -B         : Benchmark all locks and print latency percentiles in CSV\n");
+	printf("  -Y         : Benchmark all barriers from 2 to 64 threads in CSV\n");
+	printf("  -O         : Benchmark spinlock and yield with 4 threads per CPU in CSV\n");
+	printf("  -I         : Measure priority inversion with and without inheritance\n");
 	printf("\n");
 	printf(" Run with -r to check the ring buffer implementation\n");
 	printf("  -g [number]: Spawn @number generators for test\n");
 	printf("  -n [number]: Generate @number requests per generator\n");
+	printf("  -c [number]: Spawn @number counters for test\n");
 	printf("  -R         : Use random generator rather than constant generator\n");
+	printf("  -X         : Use per-thread xorshift generator rather than random()\n");
+	printf("  -V [min:max]: Generate values in [min, max) (default %d:%d)\n",
+			MIN_VALUE, MAX_VALUE);
+	printf("  -P [bytes] : Move records of @bytes (%d to %d) instead of ints\n",
+			RECORD_MIN_SIZE, RECORD_MAX_SIZE);
+	printf("  -A         : Let generators count runs of equal values locally\n");
 	printf("  -s [number]: Set the number of slots in the ring buffer\n");
+	printf("  -E [number]: Let the ring buffer grow up to @number slots under\n");
+	printf("               pressure and shrink back when it stays mostly empty\n");
+	printf("  -b [number]: Move @number values at once between generators,\n");
+	printf("               the ring buffer, and the counter\n");
+	printf("  -W         : Put each batch into the ring buffer as one run that\n");
+	printf("               never wraps, and let the counter wait for whole batches;\n");
+	printf("               -b must divide -n\n");
+	printf("  -k [type]  : Synchronize the ring buffer with spinlock (default),\n");
+	printf("               mutex, ticket, mcs, adaptive, semaphore, elided, yield, pi,\n");
+	printf("               lockfree, or sharded (a lock-free ring per generator)\n");
+	printf("  -p [type]  : Pin generators and counters to CPUs; smt (siblings of\n");
+	printf("               a core), socket (cores of a socket), cross (different\n");
+	printf("               sockets), or none (default)\n");
 	printf("  -0         : Comprehensive test with realistic values\n");
 	printf("  -1         : Test full ring buffer\n");
 	printf("  -2         : Test empty ring buffer\n");
 	printf("\n");
+	printf("  -y [type]  : Synchronize threads with pthread (default), central,\n");
+	printf("               tree, or dissemination barriers\n");
 	printf("  -h | -?    : Print usage\n");
 	printf("  -v | -q    : Make verbose or quiet\n");
 	printf("\n");
@@ -112,7 +273,7 @@ int parse_options(int argc, char * const argv[])
 	bool test_ringbuffer = false;
 	enum lock_types lock_type = lock_spinlock;
 
-	while ((opt = getopt(argc, argv, "vqg:s:n:RrSml012h?")) != -1) {
+	while ((opt = getopt(argc, argv, "vqg:c:s:E:k:b:n:p:V:P:y:RXAWrSmlT:a:BYOI012h?")) != -1) {
 		switch(opt) {
 		case 'v':
 			verbose = 1;
@@ -129,19 +290,113 @@ int parse_options(int argc, char * const argv[])
 		case 'R':
 			generator_type = generator_random;
 			break;
+		case 'X':
+			generator_type = generator_xorshift;
+			break;
+		case 'A':
+			generator_accumulate = true;
+			break;
+		case 'W':
+			whole_batches = true;
+			break;
+		case 'V':
+			if (sscanf(optarg, "%d:%d", &min_value, &max_value) != 2 ||
+					min_value < 0 || max_value <= min_value) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'P':
+			record_size = atoi(optarg);
+			if (record_size < RECORD_MIN_SIZE || record_size > RECORD_MAX_SIZE ||
+					record_size % sizeof(int)) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'g':
 			nr_generators = atoi(optarg);
 			break;
 		case 'n':
 			nr_generate = atoll(optarg);
 			break;
+		case 'c':
+			nr_counters = atoi(optarg);
+			if (nr_counters < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
 		case 'm':
 			test_locks = true;
 			lock_type = lock_mutex;
 			break;
+		case 'T':
+			test_locks = true;
+			if (__parse_lock_type(optarg) < 0 ||
+					__parse_lock_type(optarg) == lock_lockfree ||
+					__parse_lock_type(optarg) == lock_sharded) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			lock_type = __parse_lock_type(optarg);
+			break;
 		case 's':
 			nr_slots = atoi(optarg);
 			break;
+		case 'E':
+			ringbuffer_max_slots = atoi(optarg);
+			if (ringbuffer_max_slots < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			break;
+		case 'b':
+			batch_size = atoi(optarg);
+			if (batch_size < 1) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			counter_type = batch_size > 1 ? counter_batched : counter_normal;
+			break;
+		case 'a':
+			adaptive_mutex_spins = atoi(optarg);
+			break;
+		case 'B':
+			bench_locks();
+			exit(0);
+		case 'Y':
+			bench_barriers();
+			exit(0);
+		case 'O':
+			bench_oversubscribed();
+			exit(0);
+		case 'I':
+			test_priority_inversion();
+			exit(0);
+		case 'y':
+			if (__parse_barrier_type(optarg) < 0) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			barrier_type = __parse_barrier_type(optarg);
+			break;
+		case 'k':
+			if (__parse_lock_type(optarg) < 0 ||
+					__parse_lock_type(optarg) == lock_rwlock ||
+					__parse_lock_type(optarg) == lock_seqlock) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			ringbuffer_lock = __parse_lock_type(optarg);
+			break;
+		case 'p':
+			if (parse_placement(optarg) < 0) {
+				__print_usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			placement = parse_placement(optarg);
+			break;
 		case '0':
 			test_ringbuffer = true;
 			generator_type = generator_random;
@@ -174,6 +429,32 @@ int parse_options(int argc, char * const argv[])
 		}
 	}
 
+	/* Records are counted in place; only the batched counter does that */
+	if (record_size != sizeof(int)) counter_type = counter_batched;
+
+	/* Only the two-lock ring buffer can hand producers over to a new segment */
+	if (ringbuffer_max_slots && (ringbuffer_lock == lock_semaphore ||
+			ringbuffer_lock == lock_lockfree || ringbuffer_lock == lock_sharded)) {
+		fprintf(stderr, "-E does not work with the %s ring buffer\n",
+				__lock_names[ringbuffer_lock]);
+		return EXIT_FAILURE;
+	}
+
+	/* Whole batches have to fit into the ring buffer, and nothing else goes in */
+	if (whole_batches && (batch_size > nr_slots || nr_generate % batch_size)) {
+		fprintf(stderr, "-W needs batches of at most %d slots that divide -n\n",
+				nr_slots);
+		return EXIT_FAILURE;
+	}
+
+	/* The lock-free rings tell filled slots from free ones by the lap */
+	if (nr_slots < 2 && (ringbuffer_lock == lock_lockfree ||
+			ringbuffer_lock == lock_sharded)) {
+		fprintf(stderr, "The %s ring buffer needs at least 2 slots\n",
+				__lock_names[ringbuffer_lock]);
+		return EXIT_FAILURE;
+	}
+
 	if (!test_locks && !test_ringbuffer) {
 		__print_usage(argv[0]);
 		return EXIT_FAILURE;
@@ -188,8 +469,12 @@ int parse_options(int argc, char * const argv[])
 void compare_results(unsigned long generated_values[], unsigned long counted_values[])
 {
 	bool mismatch = false;
+	int nr = max_value - min_value;
 
-	for (int i = MIN_VALUE; i < MAX_VALUE; i++) {
+	/* Walk the buckets one by one only to report a mismatch */
+	if (histogram_equal(generated_values, counted_values, nr)) goto out;
+
+	for (int i = 0; i < nr; i++) {
 		if (generated_values[i] != counted_values[i]) {
 			if (!mismatch) {
 				mismatch = true;
@@ -199,24 +484,44 @@ void compare_results(unsigned long generated_values[], unsigned long counted_val
 				printf("     -----------------------------\n");
 			}
 			fprintf(stderr, "      %4d : %8lu != %-8lu\n",
-					i,generated_values[i], counted_values[i]);
+					i + min_value, generated_values[i], counted_values[i]);
 		}
 	}
 
+out:
 	printf("\n");
 	fprintf(stderr, ">>> The ring buffer is %sworking properly!! <<<\n", mismatch ? "**NOT** " : "");
 	printf("\n");
 }
 
+#ifdef CONFIG_RB_STATS
+static void __print_rb_stats(void)
+{
+	struct rb_stats stats;
+	unsigned long nr;
+
+	get_ringbuffer_stats(&stats);
+	nr = stats.nr_acquires ? stats.nr_acquires : 1;
+
+	fprintf(stderr, "    Spans acquired : %lu (%lu full, %lu empty, %lu lost races)\n",
+			stats.nr_acquires, stats.nr_full, stats.nr_empty, stats.nr_races);
+	fprintf(stderr, "  Cycles per span : %lu lock wait, %lu full/empty wait, %lu held\n",
+			(stats.wait_cycles - stats.stall_cycles) / nr,
+			stats.stall_cycles / nr, stats.hold_cycles / nr);
+}
+#endif
+
 int main(int argc, char * const argv[])
 {
 	int retval = EXIT_SUCCESS;
-	unsigned long generated_values[MAX_VALUE] = {0};
-	unsigned long counted_values[MAX_VALUE] = {0};
+	unsigned long *generated_values = NULL;
+	unsigned long *counted_values = NULL;
 	unsigned long nr_requests_to_generate;
 
 	struct timeval start, end;
 	unsigned long elapsed;
+	struct rusage usage_start, usage_end;
+	unsigned long cpu_user, cpu_sys;
 
 	__print_message("\n");
 	__print_message(" _               _      _____         _            \n");
@@ -231,6 +536,15 @@ int main(int argc, char * const argv[])
 	if ((retval = parse_options(argc, argv))) {
 		goto exit;
 	}
+	generated_values = alloc_histogram(max_value - min_value);
+	counted_values = alloc_histogram(max_value - min_value);
+	if (!generated_values || !counted_values) {
+		retval = -ENOMEM;
+		goto exit;
+	}
+	if ((retval = init_placement(placement))) {
+		goto exit;
+	}
 	if ((retval = __init_rb(nr_slots))) {
 		goto exit;
 	}
@@ -243,11 +557,17 @@ int main(int argc, char * const argv[])
 
 	spawn_generators(generator_type);
 
+	getrusage(RUSAGE_SELF, &usage_start);
 	gettimeofday(&start, NULL);
 	do_generate();
 	gettimeofday(&end, NULL);
+	getrusage(RUSAGE_SELF, &usage_end);
 	elapsed = (end.tv_sec * 1000000 + end.tv_usec) -
 				(start.tv_sec * 1000000 + start.tv_usec);
+	cpu_user = (usage_end.ru_utime.tv_sec * 1000000 + usage_end.ru_utime.tv_usec) -
+				(usage_start.ru_utime.tv_sec * 1000000 + usage_start.ru_utime.tv_usec);
+	cpu_sys = (usage_end.ru_stime.tv_sec * 1000000 + usage_end.ru_stime.tv_usec) -
+				(usage_start.ru_stime.tv_sec * 1000000 + usage_start.ru_stime.tv_usec);
 
 	fini_generators(generated_values);
 	fini_counter(counted_values);
@@ -257,10 +577,30 @@ int main(int argc, char * const argv[])
 	printf(         "  Time to complete : %lu.%06lu\n", elapsed / 1000000, elapsed % 1000000);
 	fprintf(stderr, "       Performance : %.1f req/sec\n",
 			(float)nr_requests_to_generate * 1000000 / elapsed);
+	if (record_size != sizeof(int)) {
+		fprintf(stderr, "         Bandwidth : %.1f MB/sec (%d-byte records)\n",
+				(float)nr_requests_to_generate * record_size / elapsed, record_size);
+	}
+	fprintf(stderr, "          CPU time : %lu.%06lu user, %lu.%06lu sys (%.1f%% of wall time)\n",
+			cpu_user / 1000000, cpu_user % 1000000, cpu_sys / 1000000, cpu_sys % 1000000,
+			(float)(cpu_user + cpu_sys) * 100 / elapsed);
+#ifdef CONFIG_RB_STATS
+	__print_rb_stats();
+#endif
+	if (ringbuffer_max_slots) {
+		struct rb_resize_stats stats;
+
+		get_ringbuffer_resize_stats(&stats);
+		fprintf(stderr, "           Resizes : %lu grows, %lu shrinks; %d slots now, up to %d\n",
+				stats.nr_grows, stats.nr_shrinks, stats.nr_slots, stats.max_nr_slots);
+		fprintf(stderr, "       Peak memory : %lu bytes of slots\n", stats.peak_bytes);
+	}
 	printf("\n");
 
 exit_ring:
 	__fini_rb();
 exit:
+	free(generated_values);
+	free(counted_values);
 	return retval;
 }
@@ -19,14 +19,21 @@
 #include <unistd.h>
 #include <pthread.h>
 #include <errno.h>
+#include <limits.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
 
-#include <signal.h>
 #include <sys/types.h>
 #include <sys/syscall.h>
+#include <sys/resource.h>
+#include <linux/futex.h>
+#include <cpuid.h>
 
 #include "types.h"
 #include "locks.h"
 #include "atomic.h"
+#include "affinity.h"
 #include "list_head.h"
 
 /*********************************************************************
@@ -75,504 +82,2295 @@ void acquire_spinlock(struct spinlock *lock)
  */
 void release_spinlock(struct spinlock *lock)
 {
-	lock->held = 0;
+	smp_store_release(&lock->held, 0);
+	return;
+}
+
+
+/*********************************************************************
+ * Ticket spinlock implementation
+ *
+ * Arriving threads take a ticket from @next and wait until @owner
+ * reaches it. @owner lives on its own cache line so that arrivals do not
+ * disturb the waiters, and each waiter backs off in proportion to its
+ * distance from the head of the line.
+ *********************************************************************/
+struct ticketlock {
+	int next;
+	int owner __cacheline_aligned;
+};
+
+void init_ticketlock(struct ticketlock *lock)
+{
+	lock->next = 0;
+	lock->owner = 0;
+}
+
+void acquire_ticketlock(struct ticketlock *lock)
+{
+	int ticket = fetch_and_add(&lock->next, 1);
+	int owner;
+
+	while ((owner = smp_load_acquire(&lock->owner)) != ticket) {
+		for (int i = 0; i < (ticket - owner); i++) cpu_relax();
+	}
+}
+
+void release_ticketlock(struct ticketlock *lock)
+{
+	smp_store_release(&lock->owner, lock->owner + 1);
+}
+
+
+/*********************************************************************
+ * MCS queue spinlock implementation
+ *
+ * Waiters form a queue of per-thread nodes; @tail points to the last one.
+ * Each waiter spins on its own node until its predecessor hands the lock
+ * over. Nodes come from a small per-thread stack so that the lock keeps
+ * the acquire/release interface of the other locks.
+ *********************************************************************/
+struct mcs_node {
+	struct mcs_node *next;
+	int locked;
+} __cacheline_aligned;
+
+struct mcslock {
+	struct mcs_node *tail;
+};
+
+static __thread struct mcs_node mcs_nodes[MCS_MAX_NESTING];
+static __thread int mcs_depth = 0;
+
+void init_mcslock(struct mcslock *lock)
+{
+	lock->tail = NULL;
+}
+
+void acquire_mcslock(struct mcslock *lock)
+{
+	struct mcs_node *node, *prev;
+
+	assert(mcs_depth < MCS_MAX_NESTING);
+	node = &mcs_nodes[mcs_depth++];
+	node->next = NULL;
+	node->locked = 1;
+
+	prev = xchg_ptr((void **)&lock->tail, node);
+	if (!prev) return;
+
+	WRITE_ONCE(prev->next, node);
+	while (smp_load_acquire(&node->locked)) {
+		cpu_relax();
+	}
+}
+
+void release_mcslock(struct mcslock *lock)
+{
+	struct mcs_node *node = &mcs_nodes[--mcs_depth];
+	struct mcs_node *next = READ_ONCE(node->next);
+
+	if (!next) {
+		if (compare_and_swap_ptr((void **)&lock->tail, node, NULL) == node) {
+			return;
+		}
+		/* A successor is between xchg and linking itself; wait for it */
+		while (!(next = READ_ONCE(node->next))) {
+			cpu_relax();
+		}
+	}
+	smp_store_release(&next->locked, 0);
+}
+
+
+/*********************************************************************
+ * Elided spinlock implementation
+ *
+ * A thread first runs its critical section as an RTM transaction that
+ * only reads @lock.held, so critical sections that touch different data
+ * run in parallel without ever writing the lock's cache line. Taking the
+ * spinlock for real writes @held and so aborts every transaction in
+ * flight. After ELISION_RETRIES aborts, or right away on CPUs without
+ * RTM, the thread takes the spinlock itself. Aborts are counted per
+ * reason; the counters live on their own cache line so that counting
+ * does not abort the transactions reading @held.
+ *********************************************************************/
+#define ELISION_RETRIES		3
+#define ELISION_LOCK_BUSY	0xff	/* xabort() code when @held is set */
+
+struct elided_spinlock {
+	struct spinlock lock;
+	struct elision_stats stats __cacheline_aligned;
+};
+
+static bool rtm_supported = false;
+static struct once rtm_once = ONCE_INIT;
+
+static void __detect_rtm(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+
+	rtm_supported = __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) &&
+			(ebx & bit_RTM);
+}
+
+bool elision_supported(void)
+{
+	run_once(&rtm_once, __detect_rtm);
+	return rtm_supported;
+}
+
+void init_elided_spinlock(struct elided_spinlock *lock)
+{
+	init_spinlock(&lock->lock);
+	memset(&lock->stats, 0, sizeof(lock->stats));
+	elision_supported();
+}
+
+static void __count_abort(struct elided_spinlock *lock, unsigned int status)
+{
+	unsigned long *counter = &lock->stats.nr_other;
+
+	if ((status & XABORT_EXPLICIT) && XABORT_CODE(status) == ELISION_LOCK_BUSY) {
+		counter = &lock->stats.nr_busy;
+	} else if (status & XABORT_CONFLICT) {
+		counter = &lock->stats.nr_conflict;
+	} else if (status & XABORT_CAPACITY) {
+		counter = &lock->stats.nr_capacity;
+	}
+	fetch_and_add_ulong(counter, 1);
+}
+
+void acquire_elided_spinlock(struct elided_spinlock *lock)
+{
+	for (int i = 0; rtm_supported && i < ELISION_RETRIES; i++) {
+		unsigned int status = xbegin();
+
+		if (status == XBEGIN_STARTED) {
+			if (!READ_ONCE(lock->lock.held)) return;	/* Elided */
+			xabort(ELISION_LOCK_BUSY);
+		}
+		__count_abort(lock, status);
+
+		if ((status & XABORT_EXPLICIT) && XABORT_CODE(status) == ELISION_LOCK_BUSY) {
+			/* Retrying before the holder leaves would abort again */
+			while (READ_ONCE(lock->lock.held)) {
+				cpu_relax();
+			}
+		} else if (!(status & XABORT_RETRY)) {
+			break;
+		}
+	}
+	if (rtm_supported) fetch_and_add_ulong(&lock->stats.nr_fallback, 1);
+	acquire_spinlock(&lock->lock);
+}
+
+void release_elided_spinlock(struct elided_spinlock *lock)
+{
+	/* @held is clear only if we run inside a transaction */
+	if (!READ_ONCE(lock->lock.held)) {
+		xend();
+	} else {
+		release_spinlock(&lock->lock);
+	}
+}
+
+void get_elided_spinlock_stats(struct elided_spinlock *lock, struct elision_stats *stats)
+{
+	*stats = lock->stats;
+}
+
+
+/*********************************************************************
+ * Yielding spinlock implementation
+ *
+ * A test-and-test-and-set spinlock that backs off exponentially between
+ * attempts. Once a waiter has spun for YIELD_SPINLOCK_SPINS pause
+ * instructions, it calls sched_yield() before every further attempt, so
+ * a holder preempted in an oversubscribed run is not kept off the CPU
+ * by its own waiters. The counters are updated by the lock holder, so
+ * they need no atomic operations; they sit on their own cache line to
+ * keep the waiters polling @held undisturbed.
+ *********************************************************************/
+#define YIELD_SPINLOCK_SPINS	1024
+#define YIELD_MAX_BACKOFF	64
+
+struct yield_spinlock {
+	struct spinlock lock;
+	struct yield_stats stats __cacheline_aligned;
+};
+
+void init_yield_spinlock(struct yield_spinlock *lock)
+{
+	init_spinlock(&lock->lock);
+	memset(&lock->stats, 0, sizeof(lock->stats));
+}
+
+void acquire_yield_spinlock(struct yield_spinlock *lock)
+{
+	unsigned long nr_yields = 0;
+	int backoff = 1;
+	int spins = 0;
+
+	if (compare_and_swap(&lock->lock.held, 0, 1) == 0) return;
+
+	while (READ_ONCE(lock->lock.held) ||
+			compare_and_swap(&lock->lock.held, 0, 1) != 0) {
+		if (spins < YIELD_SPINLOCK_SPINS) {
+			for (int i = 0; i < backoff; i++) cpu_relax();
+			spins += backoff;
+			if (backoff < YIELD_MAX_BACKOFF) backoff <<= 1;
+		} else {
+			sched_yield();
+			nr_yields++;
+		}
+	}
+	lock->stats.nr_contended++;
+	lock->stats.nr_yields += nr_yields;
+}
+
+void release_yield_spinlock(struct yield_spinlock *lock)
+{
+	release_spinlock(&lock->lock);
+}
+
+void get_yield_spinlock_stats(struct yield_spinlock *lock, struct yield_stats *stats)
+{
+	*stats = lock->stats;
+}
+
+
+/********************************************************************
+ * futex(2) helpers
+ ********************************************************************/
+static inline void futex_wait(int *uaddr, int val)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static inline void futex_wake(int *uaddr, int nr)
+{
+	syscall(SYS_futex, uaddr, FUTEX_WAKE_PRIVATE, nr, NULL, NULL, 0);
+}
+
+/********************************************************************
+ * Counting semaphore implementation
+ *
+ * @count never goes below zero. An uncontended wait is a single CAS and
+ * a signal is a single atomic add; only waiters that find @count at zero
+ * sleep on it with futex(2), and signalers call into the kernel only if
+ * someone announced itself in @nr_waiters.
+ ********************************************************************/
+struct semaphore {
+	int count;		/* Available units */
+	int nr_waiters;		/* Threads sleeping or about to sleep */
+};
+
+void init_sem(struct semaphore *sem, int count)
+{
+	sem->count = count;
+	sem->nr_waiters = 0;
+}
+
+bool try_wait_sem(struct semaphore *sem)
+{
+	int count;
+
+	while ((count = READ_ONCE(sem->count)) > 0) {
+		if (compare_and_swap(&sem->count, count, count - 1) == count) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void wait_sem(struct semaphore *sem)
+{
+	while (!try_wait_sem(sem)) {
+		fetch_and_add(&sem->nr_waiters, 1);	/* Implies a full barrier */
+		futex_wait(&sem->count, 0);		/* Sleep only if still zero */
+		fetch_and_add(&sem->nr_waiters, -1);
+	}
+}
+
+void signal_sem(struct semaphore *sem)
+{
+	fetch_and_add(&sem->count, 1);		/* Implies a full barrier */
+	if (READ_ONCE(sem->nr_waiters)) {
+		futex_wake(&sem->count, 1);
+	}
+}
+
+
+/********************************************************************
+ * Blocking mutex implementation
+ ********************************************************************/
+
+/*
+ * A thread waiting for a mutex. Lives on the waiter's stack and is linked
+ * into the waiter queue MCS-style, so a contended acquisition neither
+ * allocates nor takes an inner lock.
+ */
+struct mutex_waiter {
+	int granted;		/* Set by the predecessor when it leaves the queue */
+	struct mutex_waiter *next;
+};
+
+struct mutex {      //mutex lock...
+	int held;		//0: free, 1: held, 2: held and someone may sleep on it
+	struct mutex_waiter *tail;	//last waiter in FIFO order, NULL if none
+};
+/*********************************************************************
+ * init_mutex(@mutex)
+ *
+ * DESCRIPTION
+ *   Initialize the mutex instance pointed by @mutex.
+ */
+void init_mutex(struct mutex *mutex)
+{
+	mutex->held = 0;
+	mutex->tail = NULL;
+	return;
+}
+
+/*********************************************************************
+ * acquire_mutex(@mutex)
+ *
+ * DESCRIPTION
+ *   Acquire the mutex instance @mutex. Likewise acquire_spinlock(), you
+ *   should not return from this function until the calling thread gets the
+ *   mutex instance. But the calling thread should be put into sleep when
+ *   the mutex is acquired by other threads.
+ *
+ *   An uncontended acquisition is a single CAS on @held. Otherwise the
+ *   caller swaps itself into @tail and sleeps on its own futex word until
+ *   its predecessor leaves the queue. Only the waiter at the head of the
+ *   queue sleeps on @held, so the waiters get the mutex in FIFO order.
+ *   Newcomers do not take the fast path while the queue is not empty.
+ */
+/* Queue the caller on @mutex and sleep. Return true if it actually slept */
+static bool __park_on_mutex(struct mutex *mutex)
+{
+	struct mutex_waiter waiter, *prev, *next;
+	bool slept = false;
+
+	waiter.granted = 0;
+	waiter.next = NULL;
+
+	prev = xchg_ptr((void **)&mutex->tail, &waiter);
+	if (prev) {
+		WRITE_ONCE(prev->next, &waiter);
+		while (!smp_load_acquire(&waiter.granted)) {
+			futex_wait(&waiter.granted, 0);
+			slept = true;
+		}
+	}
+
+	/* At the head of the queue. Mark contended as we may sleep on @held */
+	if (compare_and_swap(&mutex->held, 0, 1) != 0) {
+		while (xchg(&mutex->held, 2) != 0) {
+			futex_wait(&mutex->held, 2);
+			slept = true;
+		}
+	}
+
+	/* Leave the queue and let the next waiter become the head */
+	if (!(next = READ_ONCE(waiter.next))) {
+		if (compare_and_swap_ptr((void **)&mutex->tail, &waiter, NULL) == &waiter) {
+			return slept;
+		}
+		/* A newcomer swapped @tail but has not linked itself yet */
+		while (!(next = READ_ONCE(waiter.next))) cpu_relax();
+	}
+
+	/* @next may return and reuse its stack right after this store */
+	smp_store_release(&next->granted, 1);
+	futex_wake(&next->granted, 1);
+	return slept;
+}
+
+void acquire_mutex(struct mutex *mutex)
+{
+	if (!READ_ONCE(mutex->tail) &&
+			compare_and_swap(&mutex->held, 0, 1) == 0) return;
+
+	__park_on_mutex(mutex);
+	return;
+}
+
+
+/*********************************************************************
+ * release_mutex(@mutex)
+ *
+ * DESCRIPTION
+ *   Release the mutex held by the calling thread.
+ *
+ *   Drop @held to 0 and wake the head waiter only if it may be sleeping on
+ *   it. The other waiters sleep on their own nodes and are not disturbed.
+ */
+void release_mutex(struct mutex *mutex)
+{
+	if (xchg(&mutex->held, 0) == 2) {
+		futex_wake(&mutex->held, 1);
+	}
 	return;
 }
 
 
-/********************************************************************
- * Blocking mutex implementation
- ********************************************************************/
+/*********************************************************************
+ * Adaptive mutex implementation
+ *
+ * A mutex that spins with exponential backoff for up to
+ * @adaptive_mutex_spins pause instructions before it parks on the
+ * waitqueue. Short critical sections are thus handed over without
+ * sleeping. The counters are updated by the lock holder, so they need no
+ * atomic operations.
+ *********************************************************************/
+#define ADAPTIVE_MAX_BACKOFF 64
+
+int adaptive_mutex_spins = 512;
+
+struct adaptive_mutex {
+	struct mutex mutex;
+	struct lock_stats stats;
+};
+
+static inline unsigned long __elapsed_ns(struct timespec *start)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000UL +
+			now.tv_nsec - start->tv_nsec;
+}
+
+void init_adaptive_mutex(struct adaptive_mutex *lock)
+{
+	init_mutex(&lock->mutex);
+	memset(&lock->stats, 0, sizeof(lock->stats));
+}
+
+void acquire_adaptive_mutex(struct adaptive_mutex *lock)
+{
+	struct mutex *mutex = &lock->mutex;
+	struct timespec start;
+	int backoff = 1;
+
+	if (compare_and_swap(&mutex->held, 0, 1) == 0) {
+		lock->stats.nr_fast++;
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (int spins = 0; spins < adaptive_mutex_spins; spins += backoff) {
+		for (int i = 0; i < backoff; i++) cpu_relax();
+		if (backoff < ADAPTIVE_MAX_BACKOFF) backoff <<= 1;
+
+		if (READ_ONCE(mutex->held) == 0 &&
+				compare_and_swap(&mutex->held, 0, 1) == 0) {
+			lock->stats.nr_spin++;
+			goto out;
+		}
+	}
+
+	if (__park_on_mutex(mutex)) {
+		lock->stats.nr_parked++;
+	} else {
+		lock->stats.nr_spin++;
+	}
+out:
+	lock->stats.wait_ns += __elapsed_ns(&start);
+}
+
+void release_adaptive_mutex(struct adaptive_mutex *lock)
+{
+	release_mutex(&lock->mutex);
+}
+
+void get_adaptive_mutex_stats(struct adaptive_mutex *lock, struct lock_stats *stats)
+{
+	*stats = lock->stats;
+}
+
+
+/*********************************************************************
+ * Priority-inheritance mutex implementation
+ *
+ * Waiters queue up in @waiters by priority, FIFO among equals, under
+ * @wait_lock and sleep on their own futex word. A waiter of a higher
+ * priority than the holder's effective one raises the holder to its own
+ * priority, and the holder drops back to its base priority once it has
+ * handed the mutex over to the first waiter. The new holder inherits
+ * the priority of the waiters left behind it.
+ *
+ * Inheritance is one level deep; a boosted holder blocked on another PI
+ * mutex does not pass the boost on. A thread should not hold more than
+ * one PI mutex at a time.
+ *********************************************************************/
+struct pi_thread {
+	pid_t tid;		/* 0 until the thread first touches a PI mutex */
+	int prio;		/* Base priority */
+};
+
+struct pi_waiter {
+	struct pi_thread *thread;
+	int granted;		/* Set by the releaser when handing over */
+	struct list_head list;
+};
+
+struct pi_mutex {
+	struct mutex wait_lock;		/* Protects the fields below */
+	bool inherit;
+	struct pi_thread *owner;
+	int boosted;			/* Priority lent to @owner, or -1 */
+	struct list_head waiters;
+	struct pi_stats stats;
+};
+
+static enum pi_modes __pi_mode = pi_simulated;
+static struct once pi_mode_once = ONCE_INIT;
+static __thread struct pi_thread pi_self;
+
+/*
+ * Find out what the process may change, trying the highest priority it
+ * will ask for; leave the caller as it was
+ */
+static void __detect_pi_mode(void)
+{
+	struct sched_param param = { .sched_priority = NR_PI_PRIOS - 1 };
+	int nice;
+
+	if (sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+		param.sched_priority = 0;
+		sched_setscheduler(0, SCHED_OTHER, &param);
+		__pi_mode = pi_fifo;
+		return;
+	}
+
+	errno = 0;
+	nice = getpriority(PRIO_PROCESS, 0);
+	if (!errno && setpriority(PRIO_PROCESS, 0, -(NR_PI_PRIOS - 1)) == 0) {
+		setpriority(PRIO_PROCESS, 0, nice);
+		__pi_mode = pi_nice;
+	}
+}
+
+enum pi_modes pi_mode(void)
+{
+	run_once(&pi_mode_once, __detect_pi_mode);
+	return __pi_mode;
+}
+
+static struct pi_thread *__pi_self(void)
+{
+	if (!pi_self.tid) {
+		pi_self.tid = syscall(SYS_gettid);
+	}
+	return &pi_self;
+}
+
+/*
+ * Run thread @tid at @prio with whatever the process is allowed to use.
+ * Return false if the system refused; simulated priorities always stick.
+ */
+static bool __pi_apply(pid_t tid, int prio)
+{
+	if (pi_mode() == pi_fifo) {
+		struct sched_param param = { .sched_priority = prio };
+
+		return sched_setscheduler(tid, prio ? SCHED_FIFO : SCHED_OTHER, &param) == 0;
+	} else if (pi_mode() == pi_nice) {
+		return setpriority(PRIO_PROCESS, tid, -prio) == 0;
+	}
+	return true;
+}
+
+/*********************************************************************
+ * set_pi_priority(@prio)
+ *
+ * DESCRIPTION
+ *   Set the base priority of the calling thread to @prio, from 0 (a normal
+ *   thread) to NR_PI_PRIOS - 1. It is SCHED_FIFO priority @prio if the
+ *   process may use SCHED_FIFO, nice -@prio if it may lower nice values,
+ *   and only recorded for the PI mutexes otherwise.
+ */
+void set_pi_priority(int prio)
+{
+	struct pi_thread *me = __pi_self();
+
+	assert(prio >= 0 && prio < NR_PI_PRIOS);
+	me->prio = prio;
+	__pi_apply(me->tid, prio);
+}
+
+void init_pi_mutex(struct pi_mutex *mutex, bool inherit)
+{
+	init_mutex(&mutex->wait_lock);
+	mutex->inherit = inherit;
+	mutex->owner = NULL;
+	mutex->boosted = -1;
+	INIT_LIST_HEAD(&mutex->waiters);
+	memset(&mutex->stats, 0, sizeof(mutex->stats));
+	pi_mode();
+}
+
+/* Lend @prio to the owner of @mutex if it runs below that */
+static void __pi_boost(struct pi_mutex *mutex, int prio)
+{
+	int current = mutex->boosted >= 0 ? mutex->boosted : mutex->owner->prio;
+
+	if (!mutex->inherit || prio <= current) return;
+	if (!__pi_apply(mutex->owner->tid, prio)) return;
+
+	mutex->boosted = prio;
+	mutex->stats.nr_boosts++;
+}
+
+void acquire_pi_mutex(struct pi_mutex *mutex)
+{
+	struct pi_thread *me = __pi_self();
+	struct pi_waiter waiter, *pos;
+
+	acquire_mutex(&mutex->wait_lock);
+	if (!mutex->owner) {
+		mutex->owner = me;
+		release_mutex(&mutex->wait_lock);
+		return;
+	}
+
+	/* Go behind the waiters of the same or a higher priority */
+	waiter.thread = me;
+	waiter.granted = 0;
+	list_for_each_entry(pos, &mutex->waiters, list) {
+		if (pos->thread->prio < me->prio) break;
+	}
+	list_add_tail(&waiter.list, &pos->list);
+	mutex->stats.nr_contended++;
+	__pi_boost(mutex, me->prio);
+	release_mutex(&mutex->wait_lock);
+
+	while (!smp_load_acquire(&waiter.granted)) {
+		futex_wait(&waiter.granted, 0);
+	}
+}
+
+void release_pi_mutex(struct pi_mutex *mutex)
+{
+	struct pi_thread *me = __pi_self();
+	struct pi_waiter *next = NULL;
+	bool boosted;
+
+	acquire_mutex(&mutex->wait_lock);
+	boosted = mutex->boosted >= 0;
+	mutex->boosted = -1;
+	mutex->owner = NULL;
+	if (!list_empty(&mutex->waiters)) {
+		next = list_first_entry(&mutex->waiters, struct pi_waiter, list);
+		list_del_init(&next->list);
+		mutex->owner = next->thread;
+		if (!list_empty(&mutex->waiters)) {
+			__pi_boost(mutex, list_first_entry(&mutex->waiters,
+						struct pi_waiter, list)->thread->prio);
+		}
+	}
+	release_mutex(&mutex->wait_lock);
+
+	if (next) {
+		/* @next may return and reuse its stack right after this store */
+		smp_store_release(&next->granted, 1);
+		futex_wake(&next->granted, 1);
+	}
+
+	/* Drop the boost only now; we could be preempted right away */
+	if (boosted) __pi_apply(me->tid, me->prio);
+}
+
+void get_pi_mutex_stats(struct pi_mutex *mutex, struct pi_stats *stats)
+{
+	*stats = mutex->stats;
+}
+
+
+/*********************************************************************
+ * Condition variable implementation
+ *
+ * Waiters sleep on @seq with the value they saw when they announced
+ * themselves in @nr_waiters. Signalers bump @seq before waking, so a
+ * waiter that has not gone to sleep yet finds @seq changed and returns
+ * right away. Signalers skip the system call when nobody waits.
+ *********************************************************************/
+void init_condvar(struct condvar *cv)
+{
+	cv->seq = 0;
+	cv->nr_waiters = 0;
+}
+
+int prepare_to_wait_condvar(struct condvar *cv)
+{
+	fetch_and_add(&cv->nr_waiters, 1);	/* Implies a full barrier */
+	return READ_ONCE(cv->seq);
+}
+
+void wait_condvar(struct condvar *cv, int ticket)
+{
+	futex_wait(&cv->seq, ticket);
+}
+
+void finish_wait_condvar(struct condvar *cv)
+{
+	fetch_and_add(&cv->nr_waiters, -1);
+}
+
+static inline void __wake_condvar(struct condvar *cv, int nr)
+{
+	/* Order the caller's update of the condition against @nr_waiters */
+	smp_mb();
+	if (!READ_ONCE(cv->nr_waiters)) return;
+
+	fetch_and_add(&cv->seq, 1);
+	futex_wake(&cv->seq, nr);
+}
+
+void signal_condvar(struct condvar *cv)
+{
+	__wake_condvar(cv, 1);
+}
+
+void broadcast_condvar(struct condvar *cv)
+{
+	__wake_condvar(cv, INT_MAX);
+}
+
+
+/*********************************************************************
+ * Reader-writer lock implementation
+ *
+ * @state holds RW_WRITER while a writer owns the lock, or the number of
+ * readers otherwise. Both sides take an uncontended lock with one atomic
+ * operation and sleep on their own condvar otherwise. Readers also stay
+ * away while @nr_writers_waiting is non-zero, which gives writers the
+ * preference.
+ *********************************************************************/
+#define RW_WRITER 0x40000000
+
+struct rwlock {
+	int state;
+	int nr_writers_waiting;
+	struct condvar readers;
+	struct condvar writers;
+};
+
+void init_rwlock(struct rwlock *lock)
+{
+	lock->state = 0;
+	lock->nr_writers_waiting = 0;
+	init_condvar(&lock->readers);
+	init_condvar(&lock->writers);
+}
+
+static inline bool __rwlock_read_blocked(struct rwlock *lock)
+{
+	return (READ_ONCE(lock->state) & RW_WRITER) ||
+			READ_ONCE(lock->nr_writers_waiting);
+}
+
+void acquire_read_rwlock(struct rwlock *lock)
+{
+	while (1) {
+		int state = READ_ONCE(lock->state);
+		int ticket;
+
+		if (!__rwlock_read_blocked(lock)) {
+			if (compare_and_swap(&lock->state, state, state + 1) == state) return;
+			continue;
+		}
+
+		ticket = prepare_to_wait_condvar(&lock->readers);
+		if (__rwlock_read_blocked(lock)) {
+			wait_condvar(&lock->readers, ticket);
+		}
+		finish_wait_condvar(&lock->readers);
+	}
+}
+
+void release_read_rwlock(struct rwlock *lock)
+{
+	/* The last reader out lets a waiting writer in */
+	if (fetch_and_add(&lock->state, -1) == 1 &&
+			READ_ONCE(lock->nr_writers_waiting)) {
+		signal_condvar(&lock->writers);
+	}
+}
+
+void acquire_write_rwlock(struct rwlock *lock)
+{
+	if (compare_and_swap(&lock->state, 0, RW_WRITER) == 0) return;
+
+	fetch_and_add(&lock->nr_writers_waiting, 1);
+	while (1) {
+		int ticket = prepare_to_wait_condvar(&lock->writers);
+
+		if (compare_and_swap(&lock->state, 0, RW_WRITER) == 0) break;
+		wait_condvar(&lock->writers, ticket);
+		finish_wait_condvar(&lock->writers);
+	}
+	finish_wait_condvar(&lock->writers);
+	fetch_and_add(&lock->nr_writers_waiting, -1);
+}
+
+void release_write_rwlock(struct rwlock *lock)
+{
+	fetch_and_add(&lock->state, -RW_WRITER);
+
+	if (READ_ONCE(lock->nr_writers_waiting)) {
+		signal_condvar(&lock->writers);
+	} else {
+		broadcast_condvar(&lock->readers);
+	}
+}
+
+
+/*********************************************************************
+ * Seqlock implementation
+ *
+ * @seq is odd while a writer is updating the protected data.
+ *********************************************************************/
+struct seqlock {
+	int seq;
+	struct spinlock lock;
+};
+
+void init_seqlock(struct seqlock *lock)
+{
+	lock->seq = 0;
+	init_spinlock(&lock->lock);
+}
+
+void write_seqlock(struct seqlock *lock)
+{
+	acquire_spinlock(&lock->lock);
+	WRITE_ONCE(lock->seq, lock->seq + 1);
+	barrier();	/* x86 keeps stores in order; just stop the compiler */
+}
+
+void write_sequnlock(struct seqlock *lock)
+{
+	smp_store_release(&lock->seq, lock->seq + 1);
+	release_spinlock(&lock->lock);
+}
+
+int read_seqbegin(struct seqlock *lock)
+{
+	int seq;
+
+	while ((seq = smp_load_acquire(&lock->seq)) & 1) {
+		cpu_relax();
+	}
+	return seq;
+}
+
+bool read_seqretry(struct seqlock *lock, int seq)
+{
+	barrier();
+	return READ_ONCE(lock->seq) != seq;
+}
+
+
+/*********************************************************************
+ * Barrier implementation
+ *
+ * Every episode ends by bumping @episode and broadcasting @release.
+ * The episode number works as the sense of a sense-reversing barrier;
+ * it is a counter rather than a bit so that a sleeper on the futex never
+ * mistakes the next episode for its own. Waiters spin for a short while
+ * before they sleep on the condvar.
+ *
+ * barrier_central counts arrivals on one word. barrier_tree counts them
+ * in a combining tree of BARRIER_TREE_FANIN children per node, so that
+ * at most that many threads hit a cache line. barrier_dissemination has
+ * no central word at all: in round r, thread i signals thread
+ * (i + 2^r) % @nr and waits for thread (i - 2^r) % @nr.
+ *********************************************************************/
+#define BARRIER_SPINS		100
+#define BARRIER_TREE_FANIN	4
+#define BARRIER_MAX_ROUNDS	16
+
+enum barrier_types barrier_type = barrier_pthread;
+
+struct barrier_node {
+	int count;		/* Children yet to arrive */
+	int nr_children;
+	int parent;		/* -1 for the root */
+} __cacheline_aligned;
+
+struct barrier_peer {
+	int episode;		/* The last episode this thread entered */
+	struct {
+		int episode;	/* The last episode the partner signalled */
+		struct condvar cv;
+	} flags[BARRIER_MAX_ROUNDS];
+} __cacheline_aligned;
+
+/* Wait until @*word reaches @episode, which is bumped before @cv is signalled */
+static void __barrier_wait_until(int *word, int episode, struct condvar *cv)
+{
+	for (int i = 0; i < BARRIER_SPINS; i++) {
+		if (smp_load_acquire(word) - episode >= 0) return;
+		cpu_relax();
+	}
+
+	while (smp_load_acquire(word) - episode < 0) {
+		int ticket = prepare_to_wait_condvar(cv);
+
+		if (READ_ONCE(*word) - episode < 0) {
+			wait_condvar(cv, ticket);
+		}
+		finish_wait_condvar(cv);
+	}
+}
+
+static int __init_barrier_tree(struct barrier *b)
+{
+	int nr_nodes = 0;
+	int base = 0;
+	int width = b->nr;
+
+	do {
+		width = (width + BARRIER_TREE_FANIN - 1) / BARRIER_TREE_FANIN;
+		nr_nodes += width;
+	} while (width > 1);
+
+	b->nodes = aligned_alloc(CACHELINE_SIZE, sizeof(*b->nodes) * nr_nodes);
+	if (!b->nodes) return -ENOMEM;
+
+	/* Leaves come first, and each level right after its children */
+	width = b->nr;
+	do {
+		int level = (width + BARRIER_TREE_FANIN - 1) / BARRIER_TREE_FANIN;
+
+		for (int i = 0; i < level; i++) {
+			struct barrier_node *node = b->nodes + base + i;
+			int left = width - i * BARRIER_TREE_FANIN;
+
+			node->nr_children = left < BARRIER_TREE_FANIN ? left : BARRIER_TREE_FANIN;
+			node->count = node->nr_children;
+			node->parent = level > 1 ? base + level + i / BARRIER_TREE_FANIN : -1;
+		}
+		base += level;
+		width = level;
+	} while (width > 1);
+	return 0;
+}
+
+static int __init_barrier_dissemination(struct barrier *b)
+{
+	assert(b->nr <= (1 << BARRIER_MAX_ROUNDS));
+
+	b->peers = aligned_alloc(CACHELINE_SIZE, sizeof(*b->peers) * b->nr);
+	if (!b->peers) return -ENOMEM;
+
+	for (int i = 0; i < b->nr; i++) {
+		struct barrier_peer *peer = b->peers + i;
+
+		peer->episode = 0;
+		for (int r = 0; r < BARRIER_MAX_ROUNDS; r++) {
+			peer->flags[r].episode = 0;
+			init_condvar(&peer->flags[r].cv);
+		}
+	}
+	return 0;
+}
+
+/*********************************************************************
+ * init_barrier(@b, @type, @nr)
+ *
+ * DESCRIPTION
+ *   Initialize @b for @nr threads to meet with the algorithm @type.
+ *
+ * RETURN
+ *   0 on success. -ENOMEM if the tree or the flags cannot be allocated.
+ */
+int init_barrier(struct barrier *b, enum barrier_types type, int nr)
+{
+	assert(nr > 0);
+
+	b->type = type;
+	b->nr = nr;
+	b->count = nr;
+	b->episode = 0;
+	init_condvar(&b->release);
+	b->nodes = NULL;
+	b->peers = NULL;
+
+	if (type == barrier_pthread) {
+		return -pthread_barrier_init(&b->pthread, NULL, nr);
+	} else if (type == barrier_tree) {
+		return __init_barrier_tree(b);
+	} else if (type == barrier_dissemination) {
+		return __init_barrier_dissemination(b);
+	}
+	return 0;
+}
+
+static inline void __release_barrier(struct barrier *b, int episode)
+{
+	smp_store_release(&b->episode, episode);
+	broadcast_condvar(&b->release);
+}
+
+static void __wait_barrier_central(struct barrier *b)
+{
+	/* @episode cannot move on before we arrive */
+	int episode = READ_ONCE(b->episode) + 1;
+
+	if (fetch_and_add(&b->count, -1) == 1) {
+		WRITE_ONCE(b->count, b->nr);
+		__release_barrier(b, episode);
+	} else {
+		__barrier_wait_until(&b->episode, episode, &b->release);
+	}
+}
+
+static void __wait_barrier_tree(struct barrier *b, int id)
+{
+	int episode = READ_ONCE(b->episode) + 1;
+	int index = id / BARRIER_TREE_FANIN;
+
+	/* The last child to arrive at a node goes on to its parent */
+	while (1) {
+		struct barrier_node *node = b->nodes + index;
+
+		if (fetch_and_add(&node->count, -1) != 1) break;
+
+		WRITE_ONCE(node->count, node->nr_children);
+		if (node->parent < 0) {
+			__release_barrier(b, episode);
+			return;
+		}
+		index = node->parent;
+	}
+	__barrier_wait_until(&b->episode, episode, &b->release);
+}
+
+static void __wait_barrier_dissemination(struct barrier *b, int id)
+{
+	struct barrier_peer *me = b->peers + id;
+	int episode = ++me->episode;
+
+	for (int r = 0; (1 << r) < b->nr; r++) {
+		struct barrier_peer *partner = b->peers + (id + (1 << r)) % b->nr;
+
+		/* Only we signal @partner in round @r, so its flag never goes back */
+		smp_store_release(&partner->flags[r].episode, episode);
+		signal_condvar(&partner->flags[r].cv);
+
+		__barrier_wait_until(&me->flags[r].episode, episode, &me->flags[r].cv);
+	}
+}
+
+/*********************************************************************
+ * wait_barrier(@b, @id)
+ *
+ * DESCRIPTION
+ *   Wait at @b as thread @id until all the @nr threads have arrived.
+ *   Each of the @nr threads should use a distinct @id below @nr.
+ */
+void wait_barrier(struct barrier *b, int id)
+{
+	assert(id >= 0 && id < b->nr);
+
+	if (b->type == barrier_pthread) {
+		pthread_barrier_wait(&b->pthread);
+	} else if (b->type == barrier_central) {
+		__wait_barrier_central(b);
+	} else if (b->type == barrier_tree) {
+		__wait_barrier_tree(b, id);
+	} else if (b->type == barrier_dissemination) {
+		__wait_barrier_dissemination(b, id);
+	}
+}
+
+void fini_barrier(struct barrier *b)
+{
+	if (b->type == barrier_pthread) {
+		pthread_barrier_destroy(&b->pthread);
+	}
+	free(b->nodes);
+	free(b->peers);
+	b->nodes = NULL;
+	b->peers = NULL;
+}
+
+
+/*********************************************************************
+ * Countdown latch implementation
+ *********************************************************************/
+void init_latch(struct latch *latch, int count)
+{
+	latch->count = count;
+	init_condvar(&latch->done);
+}
+
+void count_down_latch(struct latch *latch)
+{
+	if (fetch_and_add(&latch->count, -1) == 1) {
+		broadcast_condvar(&latch->done);
+	}
+}
+
+void wait_latch(struct latch *latch)
+{
+	while (smp_load_acquire(&latch->count) > 0) {
+		int ticket = prepare_to_wait_condvar(&latch->done);
+
+		if (READ_ONCE(latch->count) > 0) {
+			wait_condvar(&latch->done, ticket);
+		}
+		finish_wait_condvar(&latch->done);
+	}
+}
+
+
+/*********************************************************************
+ * Once implementation
+ *********************************************************************/
+#define ONCE_NONE	0
+#define ONCE_RUNNING	1
+#define ONCE_DONE	2
+
+void run_once(struct once *once, void (*fn)(void))
+{
+	if (smp_load_acquire(&once->state) == ONCE_DONE) return;
+
+	if (compare_and_swap(&once->state, ONCE_NONE, ONCE_RUNNING) == ONCE_NONE) {
+		fn();
+		smp_store_release(&once->state, ONCE_DONE);
+		broadcast_condvar(&once->done);
+		return;
+	}
+
+	while (smp_load_acquire(&once->state) != ONCE_DONE) {
+		int ticket = prepare_to_wait_condvar(&once->done);
+
+		if (READ_ONCE(once->state) != ONCE_DONE) {
+			wait_condvar(&once->done, ticket);
+		}
+		finish_wait_condvar(&once->done);
+	}
+}
+/*********************************************************************
+ * Ring buffer
+ *
+ * Producers and consumers each serialize on their own lock, so a
+ * producer and a consumer run in parallel. Everything one side writes
+ * lives on cache lines of its own: producers own @producer, @tail and
+ * @cached_head; consumers own @consumer, @head and @cached_tail. The
+ * other side's index is read only when the cached copy says the buffer
+ * is full (or empty), so in the steady state neither side pulls the
+ * other's line.
+ *
+ * @tail and @head are free-running 64-bit positions; the slot for
+ * position @pos is @pos % nr_slots and @tail - @head is the fill level.
+ * Each slot holds one record of @record_size bytes.
+ *
+ * The slots live in segments. A fixed-size buffer has only one. An
+ * elastic buffer (@ringbuffer_max_slots > 0) hands producers over to a
+ * new segment of twice the size when they stall on a full buffer for
+ * more than RB_GROW_STALL_NS in a period of RB_PERIOD reservations. It
+ * hands them over to a segment of half the size after RB_SHRINK_PERIODS
+ * periods in a row end up at most a quarter full. The handover happens
+ * under the producer lock: the old segment gets the position where it
+ * ends and a link to the new one, and producers fill the new segment
+ * from @tail on. Consumers drain the old segment up to that position,
+ * move on to the new one under the consumer lock, and free the old one;
+ * nobody else can be looking at it by then. The first segment uses
+ * @slots, which must stay valid, so its slots are kept until
+ * fini_ringbuffer().
+ *
+ * A producer that needs more slots than are left before the wrap marks
+ * them as padding at @pad_at and takes its slots from the start of the
+ * segment. Consumers skip the padding. Room for the padding and the run
+ * after it means consumers are past the previous padding, so one marker
+ * per segment is enough.
+ *********************************************************************/
+#define RB_GROW_STALL_NS	1000000UL
+#define RB_PERIOD		1024
+#define RB_SHRINK_PERIODS	4
+
+struct rb_segment {
+	int nr_slots;
+	int *slots;
+	unsigned long base;		/* Position stored in the first slot */
+	unsigned long end;		/* Position where @next takes over */
+	unsigned long pad_at;		/* Padding from here up to the wrap */
+	struct rb_segment *next;	/* Set once producers have moved on */
+};
+
+/* One side's lock. The live member depends on @ringbuffer.type */
+union rb_lock {
+	struct spinlock spl;
+	struct mutex mtl;
+	struct ticketlock tkl;
+	struct mcslock mcl;
+	struct adaptive_mutex aml;
+	struct elided_spinlock esl;
+	struct yield_spinlock ysl;
+	struct pi_mutex pml;
+	struct semaphore sem;		/* Binary semaphore for lock_semaphore */
+};
+
+struct ringbuffer {
+	/** NEVER CHANGE @nr_slots AND @slots ****/
+	/**/ int nr_slots;                     /**/
+	/**/ int *slots;                       /**/
+	/*****************************************/
+	enum lock_types type;
+	int min_slots;			/* An elastic buffer never shrinks below */
+
+	/* Written by producers only */
+	union rb_lock producer __cacheline_aligned;
+	unsigned long tail;		/* Next position to fill */
+	unsigned long cached_head;	/* Last @head seen by producers */
+	struct rb_segment *fill;	/* Segment holding @tail */
+	unsigned long stall_ns;		/* Stalled on full in this period */
+	int nr_reserves;		/* Reservations in this period */
+	int nr_low_periods;		/* Periods in a row at most a quarter full */
+
+	/* Written by consumers only */
+	union rb_lock consumer __cacheline_aligned;
+	unsigned long head;		/* Next position to take out */
+	unsigned long cached_tail;	/* Last @tail seen by consumers */
+	struct rb_segment *drain;	/* Segment holding @head */
+} __cacheline_aligned;
+//nr_slots is size of ring buffer
+//slots is location of ringbuffer
+
+struct ringbuffer ringbuffer = {
+	
+
+	
+};
+static struct condvar not_full __cacheline_aligned;	//producers wait here when full
+static struct condvar not_empty __cacheline_aligned;	//consumers wait here when empty
+static struct semaphore slots_free;	//lock_semaphore: free slots
+static struct semaphore slots_filled;	//lock_semaphore: values in the buffer
+
+/*
+ * Hot-path statistics (make STATS=1). Each thread counts into its own
+ * cache line, registered on a global list at its first use, and
+ * get_ringbuffer_stats() sums them up. RB_STAT() drops its argument
+ * when CONFIG_RB_STATS is not set, so the default build pays nothing.
+ */
+#ifdef CONFIG_RB_STATS
+#define RB_STAT(x) x
+
+struct rb_thread_stats {
+	struct rb_stats stats;
+	struct rb_thread_stats *next;
+} __cacheline_aligned;
+
+static struct rb_thread_stats *rb_stats_list = NULL;
+static __thread struct rb_thread_stats *my_stats = NULL;
+
+static struct rb_stats *__rb_stats(void)
+{
+	if (!my_stats) {
+		struct rb_thread_stats *next;
+
+		my_stats = aligned_alloc(CACHELINE_SIZE, sizeof(*my_stats));
+		assert(my_stats);
+		memset(my_stats, 0, sizeof(*my_stats));
+		do {
+			next = READ_ONCE(rb_stats_list);
+			my_stats->next = next;
+		} while (compare_and_swap_ptr((void **)&rb_stats_list, next, my_stats) != next);
+	}
+	return &my_stats->stats;
+}
+
+void get_ringbuffer_stats(struct rb_stats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	for (struct rb_thread_stats *t = rb_stats_list; t; t = t->next) {
+		stats->nr_acquires += t->stats.nr_acquires;
+		stats->nr_full += t->stats.nr_full;
+		stats->nr_empty += t->stats.nr_empty;
+		stats->nr_races += t->stats.nr_races;
+		stats->wait_cycles += t->stats.wait_cycles;
+		stats->stall_cycles += t->stats.stall_cycles;
+		stats->hold_cycles += t->stats.hold_cycles;
+	}
+}
+
+static void __fini_rb_stats(void)
+{
+	while (rb_stats_list) {
+		struct rb_thread_stats *t = rb_stats_list;
+
+		rb_stats_list = t->next;
+		free(t);
+	}
+	my_stats = NULL;
+}
+#else
+#define RB_STAT(x)
+#endif
+
+/* The record for position @pos */
+static inline void *__slot(int *slots, int nr_slots, unsigned long pos)
+{
+	return (char *)slots + (size_t)record_size * (pos % nr_slots);
+}
+
+static struct rb_resize_stats rb_resize_stats;
+static unsigned long rb_segment_bytes;	/* Held by live segments */
+
+static struct rb_segment *__alloc_rb_segment(int nr_slots, unsigned long base, int *slots)
+{
+	struct rb_segment *seg = malloc(sizeof(*seg));
+	unsigned long bytes;
+
+	if (!seg) return NULL;
+	if (!slots && !(slots = alloc_placed((size_t)record_size * nr_slots))) {
+		free(seg);
+		return NULL;
+	}
+
+	seg->nr_slots = nr_slots;
+	seg->slots = slots;
+	seg->base = base;
+	seg->end = ULONG_MAX;
+	seg->pad_at = ULONG_MAX;
+	seg->next = NULL;
+
+	bytes = fetch_and_add_ulong(&rb_segment_bytes, (size_t)record_size * nr_slots) +
+			(size_t)record_size * nr_slots;
+	if (bytes > rb_resize_stats.peak_bytes) rb_resize_stats.peak_bytes = bytes;
+	return seg;
+}
+
+/* The slots of the first segment are @ringbuffer.slots; they stay until fini */
+static void __free_rb_segment(struct rb_segment *seg)
+{
+	if (seg->slots != ringbuffer.slots) {
+		fetch_and_add_ulong(&rb_segment_bytes, -(size_t)record_size * seg->nr_slots);
+		free(seg->slots);
+	}
+	free(seg);
+}
+
+/* The record for position @pos in @seg */
+static inline void *__seg_slot(struct rb_segment *seg, unsigned long pos)
+{
+	return __slot(seg->slots, seg->nr_slots, pos - seg->base);
+}
+
+/* Up to @nr slots from @pos on, without wrapping around the end of @seg */
+static inline int __seg_contig(struct rb_segment *seg, unsigned long pos, int nr)
+{
+	int contig = seg->nr_slots - (pos - seg->base) % seg->nr_slots;
+
+	return contig < nr ? contig : nr;
+}
+
+/* Slots to pad at @pos before a run of @min slots, or 0 if the run fits */
+static inline int __seg_pad(struct rb_segment *seg, unsigned long pos, int min)
+{
+	int contig = __seg_contig(seg, pos, min);
+
+	return contig < min ? contig : 0;
+}
+
+/* Up to @nr slots from @head on, stopping at the wrap and at padding */
+static inline int __seg_run(struct rb_segment *seg, unsigned long head, int nr)
+{
+	unsigned long pad_at = READ_ONCE(seg->pad_at);
+	int contig = __seg_contig(seg, head, nr);
+
+	if (pad_at > head && pad_at - head < contig) contig = pad_at - head;
+	return contig;
+}
+
+/* Slots of @seg in use, given the positions @tail and @head */
+static inline unsigned long __seg_used(struct rb_segment *seg,
+		unsigned long tail, unsigned long head)
+{
+	return tail - (head > seg->base ? head : seg->base);
+}
+
+/*
+ * Let producers fill a new segment of @nr_slots from @tail on. The caller
+ * holds the producer lock.
+ */
+static bool __rb_handover(int nr_slots)
+{
+	struct rb_segment *old = ringbuffer.fill;
+	struct rb_segment *seg = __alloc_rb_segment(nr_slots, ringbuffer.tail, NULL);
+
+	if (!seg) return false;
+
+	old->end = ringbuffer.tail;
+	smp_store_release(&old->next, seg);	/* Consumers read @end after @next */
+	ringbuffer.fill = seg;
+
+	if (nr_slots > old->nr_slots) {
+		rb_resize_stats.nr_grows++;
+	} else {
+		rb_resize_stats.nr_shrinks++;
+	}
+	if (nr_slots > rb_resize_stats.max_nr_slots) rb_resize_stats.max_nr_slots = nr_slots;
+	ringbuffer.stall_ns = 0;
+	ringbuffer.nr_low_periods = 0;
+	return true;
+}
+
+/* Grow if producers have stalled long enough in this period */
+static bool __rb_try_grow(void)
+{
+	int nr_slots = ringbuffer.fill->nr_slots * 2;
+
+	if (ringbuffer.stall_ns < RB_GROW_STALL_NS) return false;
+	if (nr_slots > ringbuffer_max_slots) nr_slots = ringbuffer_max_slots;
+	if (nr_slots <= ringbuffer.fill->nr_slots) return false;
+
+	return __rb_handover(nr_slots);
+}
+
+/* Close a period every RB_PERIOD reservations, and shrink if it was quiet */
+static void __rb_try_shrink(void)
+{
+	struct rb_segment *seg = ringbuffer.fill;
+
+	if (++ringbuffer.nr_reserves < RB_PERIOD) return;
+	ringbuffer.nr_reserves = 0;
+	ringbuffer.stall_ns = 0;
+	if (seg->nr_slots <= ringbuffer.min_slots) return;
+
+	/* @cached_head may be way behind; look at the real one once a period */
+	ringbuffer.cached_head = smp_load_acquire(&ringbuffer.head);
+	if (__seg_used(seg, ringbuffer.tail, ringbuffer.cached_head) > seg->nr_slots / 4) {
+		ringbuffer.nr_low_periods = 0;
+		return;
+	}
+	if (++ringbuffer.nr_low_periods < RB_SHRINK_PERIODS) return;
+
+	__rb_handover(seg->nr_slots / 2 > ringbuffer.min_slots ?
+			seg->nr_slots / 2 : ringbuffer.min_slots);
+}
+
+/*
+ * Move consumers on to the next segment once they have drained the one
+ * at @head. The caller holds the consumer lock.
+ */
+static struct rb_segment *__rb_drain_segment(unsigned long head)
+{
+	struct rb_segment *seg = ringbuffer.drain;
+	struct rb_segment *next;
+
+	while ((next = smp_load_acquire(&seg->next)) && head == seg->end) {
+		ringbuffer.drain = next;
+		__free_rb_segment(seg);
+		seg = next;
+	}
+	return seg;
+}
+
+void get_ringbuffer_resize_stats(struct rb_resize_stats *stats)
+{
+	*stats = rb_resize_stats;
+	stats->nr_slots = ringbuffer.fill ? ringbuffer.fill->nr_slots : ringbuffer.nr_slots;
+}
+
+static inline void __wake_up(struct condvar *cv, int nr)
+{
+	if (nr == 1) {
+		signal_condvar(cv);
+	} else {
+		broadcast_condvar(cv);
+	}
+}
+
+/*
+ * Hand the padding at @head back to producers. The caller holds the
+ * consumer lock and has seen @tail beyond @head.
+ */
+static unsigned long __rb_skip_pad(struct rb_segment *seg, unsigned long head)
+{
+	int pad = __seg_contig(seg, head, seg->nr_slots);
+
+	head += pad;
+	smp_store_release(&ringbuffer.head, head);
+	if (ringbuffer.type == lock_semaphore) {
+		for (int i = 0; i < pad; i++) signal_sem(&slots_free);
+	} else {
+		__wake_up(&not_full, pad);
+	}
+	return head;
+}
+
+/*********************************************************************
+ * Lock-free ring (lock_lockfree, lock_sharded)
+ *
+ * Bounded MPMC queue with a sequence number per slot. Producers claim
+ * positions by advancing @tail, consumers by advancing @head; both
+ * are free-running 64-bit positions, so the slot for position @pos is
+ * @pos % nr_slots and they never wrap in practice.
+ *
+ *   seq[slot] == pos                    : slot is free for the producer at @pos
+ *   seq[slot] == pos + 1                : slot holds the value for @pos
+ *   seq[slot] == (pos + 1) | LFRING_PAD : slot is padding, skipped by consumers
+ *   seq[slot] == pos + nr_slots         : slot is free for the next lap
+ *
+ * A thread claims a run of consecutive slots with a single CAS, works on
+ * them in place, and publishes the whole run afterwards. A run never
+ * wraps around the end of @slots. A producer that needs more slots than
+ * are left before the wrap claims those as padding along with its run
+ * from the start of @slots, and consumers hand the padding straight back.
+ *********************************************************************/
+#define LFRING_PAD	(1UL << (sizeof(unsigned long) * 8 - 1))
+
+struct lfring {
+	unsigned long tail __cacheline_aligned;
+	unsigned long head __cacheline_aligned;
+
+	int nr_slots __cacheline_aligned;
+	int *slots;
+	unsigned long *seq;
+	struct condvar *not_full;	/* Where producers wait */
+	struct condvar *not_empty;	/* Where consumers wait */
+};
+
+static struct lfring lfring;
+
+static int init_lfring(struct lfring *ring, int *slots, int nr_slots,
+		struct condvar *not_full, struct condvar *not_empty)
+{
+	/* With one slot, filled for @pos and free for the next lap look alike */
+	if (nr_slots < 2) return -EINVAL;
+
+	ring->head = ring->tail = 0;
+	ring->nr_slots = nr_slots;
+	ring->slots = slots;
+	ring->not_full = not_full;
+	ring->not_empty = not_empty;
+
+	ring->seq = malloc(sizeof(*ring->seq) * nr_slots);
+	if (!ring->seq) return -ENOMEM;
+	for (int i = 0; i < nr_slots; i++) {
+		ring->seq[i] = i;
+	}
+	return 0;
+}
+
+static void fini_lfring(struct lfring *ring)
+{
+	free(ring->seq);
+}
+
+/* Sleep on @cv unless @seq moved away from @old */
+static void __lf_wait(struct condvar *cv, unsigned long *seq, unsigned long old)
+{
+	int ticket = prepare_to_wait_condvar(cv);
+	RB_STAT(unsigned long start = rdtsc());
+
+	if (smp_load_acquire(seq) == old) {
+		wait_condvar(cv, ticket);
+	}
+	finish_wait_condvar(cv);
+	RB_STAT(__rb_stats()->stall_cycles += rdtsc() - start);
+}
+
+/*
+ * Claim at least @min and up to @nr free slots starting at *@ppos. If
+ * fewer than @min are left before the wrap, claim them as padding too and
+ * store their number in *@ppad. When there is not enough room, sleep if
+ * @wait or return 0 otherwise. Publish them with lfring_commit().
+ */
+static int lfring_reserve(struct lfring *ring, int min, int nr,
+		unsigned long *ppos, int *ppad, bool wait)
+{
+	const unsigned long nr_slots = ring->nr_slots;
+	unsigned long pos = READ_ONCE(ring->tail);
+	unsigned long start, prev;
+	int claimed;
+
+	while (1) {
+		int pad = nr_slots - pos % nr_slots;	/* Up to the wrap */
+		int max;
 
-struct thread {
-	pthread_t pthread;      //스레드 id
-	struct list_head list;  
-};
+		if (pad >= min) pad = 0;
+		start = pos + pad;
+		max = nr_slots - start % nr_slots;
+		if (max > nr) max = nr;
+		for (claimed = -pad; claimed < max; claimed++) {
+			unsigned long p = start + claimed;
+			if (smp_load_acquire(&ring->seq[p % nr_slots]) != p) break;
+		}
+		if (claimed < min) {	/* Full, or someone raced us */
+			unsigned long p = start + claimed;
+			unsigned long *seq = &ring->seq[p % nr_slots];
+			unsigned long s = smp_load_acquire(seq);
 
+			if ((long)((s & ~LFRING_PAD) - p) < 0) {
+				if (!wait) return 0;
+				RB_STAT(__rb_stats()->nr_full++);
+				__lf_wait(ring->not_full, seq, s);
+			}
+			pos = READ_ONCE(ring->tail);
+			continue;
+		}
+		prev = compare_and_swap_ulong(&ring->tail, pos, start + claimed);
+		if (prev == pos) break;
+		RB_STAT(__rb_stats()->nr_races++);
+		pos = prev;
+	}
+	*ppos = start;
+	*ppad = start - pos;
+	return claimed;
+}
 
-struct thread *caller;  //함수를 호출한 스레드 저장할 변수
-struct thread *next;        //다음 스레드를 저장할 변수
-
-void signal_handler(int sig){       //SIGUSR1에 해당하는 핸들러 함수
-	//printf("mutex holder wake!! LOCK RELEASE!!!\n");
-}/*
-void signal_release_handler(int sig){
-	printf("release!!!!!!!!\n");
-}
-struct sigaction sa = {
-	.sa_handler = signal_handler,
-	.sa_flags   = 0,
-},old_sa;
-*/
-sigset_t set;
-//sigset_t release_set;
-//siginfo_t info;
-//bool check = false;
-int cnt = 0;
-/*****************************************
-		semaphore
-******************************************/
-
-struct semaphore{           //semaphore
-	int s;
-	struct spinlock spl;        //spinlock (prevent race condition)
-	struct list_head waitqueue;
-};
+static void lfring_commit(struct lfring *ring, unsigned long pos, int pad, int nr)
+{
+	const unsigned long nr_slots = ring->nr_slots;
+
+	for (unsigned long p = pos - pad; p < pos; p++) {
+		smp_store_release(&ring->seq[p % nr_slots], (p + 1) | LFRING_PAD);
+	}
+	for (int i = 0; i < nr; i++) {
+		smp_store_release(&ring->seq[(pos + i) % nr_slots], pos + i + 1);
+	}
+	__wake_up(ring->not_empty, pad + nr);
+}
+
+static void lfring_release(struct lfring *ring, unsigned long pos, int nr)
+{
+	const unsigned long nr_slots = ring->nr_slots;
+
+	for (int i = 0; i < nr; i++) {
+		smp_store_release(&ring->seq[(pos + i) % nr_slots], pos + i + nr_slots);
+	}
+	__wake_up(ring->not_full, nr);
+}
+
+/*
+ * Claim at least @min and up to @max filled slots starting at *@ppos, or
+ * fewer if the run ends at the wrap or at padding. Padding found at the
+ * head is handed back on the way. When there is not enough, sleep if @wait
+ * or return 0 otherwise. Hand them back with lfring_release().
+ */
+static int lfring_peek(struct lfring *ring, int min, int max, unsigned long *ppos, bool wait)
+{
+	const unsigned long nr_slots = ring->nr_slots;
+	unsigned long pos = READ_ONCE(ring->head);
+	unsigned long prev;
+	int claimed;
+
+	while (1) {
+		int nr = nr_slots - pos % nr_slots;	/* Up to the wrap */
+		int need = min;
+
+		if (nr > max) nr = max;
+		for (claimed = 0; claimed < nr; claimed++) {
+			unsigned long p = pos + claimed;
+			unsigned long s = smp_load_acquire(&ring->seq[p % nr_slots]);
 
-void init_sem(struct semaphore *sem,int s){             //initialize
-	sem->s = s;
-	init_spinlock(&sem->spl);           
-	INIT_LIST_HEAD(&sem->waitqueue);
+			if (s == p + 1) continue;
+			if (s == ((p + 1) | LFRING_PAD)) need = claimed;	/* The run ends here */
+			break;
+		}
+		if (!claimed && need == 0) {	/* Padding. Take it and hand it back */
+			while (claimed < nr_slots - pos % nr_slots &&
+					smp_load_acquire(&ring->seq[(pos + claimed) % nr_slots]) ==
+					((pos + claimed + 1) | LFRING_PAD)) {
+				claimed++;
+			}
+			prev = compare_and_swap_ulong(&ring->head, pos, pos + claimed);
+			if (prev == pos) {
+				lfring_release(ring, pos, claimed);
+				pos += claimed;
+			} else {
+				RB_STAT(__rb_stats()->nr_races++);
+				pos = prev;
+			}
+			continue;
+		}
+		if (need > nr) need = nr;
+		if (claimed < need) {	/* Empty, or someone raced us */
+			unsigned long p = pos + claimed;
+			unsigned long *seq = &ring->seq[p % nr_slots];
+			unsigned long s = smp_load_acquire(seq);
 
+			if ((long)((s & ~LFRING_PAD) - (p + 1)) < 0) {
+				if (!wait) return 0;
+				RB_STAT(__rb_stats()->nr_empty++);
+				__lf_wait(ring->not_empty, seq, s);
+			}
+			pos = READ_ONCE(ring->head);
+			continue;
+		}
+		prev = compare_and_swap_ulong(&ring->head, pos, pos + claimed);
+		if (prev == pos) break;
+		RB_STAT(__rb_stats()->nr_races++);
+		pos = prev;
+	}
+	*ppos = pos;
+	return claimed;
 }
-void wait_sem(struct semaphore *sem){       //acquire
-    //전체적인 구조는 mutex와 똑같음
-	acquire_spinlock(&sem->spl);
-	sem->s--;
-	if(sem->s < 0)
-	{
-		//sigprocmask(SIG_BLOCK,&set,NULL);
-		caller = malloc(sizeof(struct thread)*1); 	
-		INIT_LIST_HEAD(&caller->list);
-		caller->pthread = pthread_self();
 
-		//acquire_spinlock(&mutex->spl);
-		list_add_tail(&caller->list,&sem->waitqueue);		
-		release_spinlock(&sem->spl);			
+/*********************************************************************
+ * Sharded ring buffer (lock_sharded)
+ *
+ * One lock-free ring per generator. A producer sticks to the shard it
+ * gets on its first enqueue. Counter #k owns the shards whose index is
+ * k modulo nr_counters and drains them round-robin. When all of them are
+ * empty it steals from the other shards, and it sleeps only when every
+ * shard is empty. All shards share the consumer-side condvar.
+ *********************************************************************/
+struct rb_shard {
+	struct lfring ring;
+	struct condvar not_full;
+} __cacheline_aligned;
+
+static struct rb_shard *shards = NULL;
+static int nr_shards = 0;
+static int nr_producers = 0;		/* Producers seen so far */
+static int nr_consumers = 0;		/* Consumers seen so far */
+static __thread int my_producer = -1;
+static __thread int my_consumer = -1;
+static __thread int my_next_shard = -1;	/* Next home shard to drain */
+
+static struct lfring *__sharded_reserve(int min, int nr, unsigned long *ppos, int *ppad,
+		int *reserved)
+{
+	struct lfring *ring;
 
-		//sigprocmask(SIG_UNBLOCK,&set,NULL);
-		//pause();
-		sigwaitinfo(&set,NULL);
+	if (my_producer < 0) {
+		my_producer = fetch_and_add(&nr_producers, 1);
 	}
+	ring = &shards[my_producer % nr_shards].ring;
+	*reserved = lfring_reserve(ring, min, nr, ppos, ppad, true);
+	return ring;
 }
-void signal_sem(struct semaphore *sem){     //release
-	
-	sem->s++;	
-	if(sem->s <= 0)
-	{
-		acquire_spinlock(&sem->spl);
-		next = list_first_entry(&sem->waitqueue,struct thread,list);
-		list_del_init(&next->list);
-		
-		release_spinlock(&sem->spl);
-		while(1)
-		{
-			if(!(pthread_kill(next->pthread,SIGUSR1)))
-			{
-				break;
-			}	
-		}
-		
-	}
-	else
-	{
-		release_spinlock(&sem->spl);
-		return;
+
+static struct lfring *__sharded_try_peek(int min, int max, unsigned long *ppos, int *nr)
+{
+	/* Drain home shards round-robin */
+	if (my_next_shard < nr_shards) {
+		int first = my_next_shard;
+		do {
+			int shard = my_next_shard;
+
+			my_next_shard += nr_counters;
+			if (my_next_shard >= nr_shards) my_next_shard = my_consumer;
+
+			*nr = lfring_peek(&shards[shard].ring, min, max, ppos, false);
+			if (*nr) return &shards[shard].ring;
+		} while (my_next_shard != first);
 	}
+
+	/* Home shards are all empty. Steal from others */
+	for (int i = 0; i < nr_shards; i++) {
+		int shard = (my_consumer + i) % nr_shards;
+
+		if (shard % nr_counters == my_consumer) continue;
+		*nr = lfring_peek(&shards[shard].ring, min, max, ppos, false);
+		if (*nr) return &shards[shard].ring;
+	}
+	return NULL;
 }
 
-struct mutex {      //mutex lock...
-	struct spinlock spl;        //use spinlock to prevent race condition
-	int held;		//held value(lock hold)
-	struct list_head waitqueue;		//thread id queue
-//	struct semaphore sem;
-	
-	
+static struct lfring *__sharded_peek(int min, int max, unsigned long *ppos, int *nr)
+{
+	struct lfring *ring;
+
+	if (my_consumer < 0) {
+		my_consumer = fetch_and_add(&nr_consumers, 1);
+		my_next_shard = my_consumer;
+	}
+
+	while (!(ring = __sharded_try_peek(min, max, ppos, nr))) {
+		int ticket = prepare_to_wait_condvar(&not_empty);
+		RB_STAT(unsigned long start = rdtsc());
+
+		RB_STAT(__rb_stats()->nr_empty++);
+		ring = __sharded_try_peek(min, max, ppos, nr);
+		if (!ring) wait_condvar(&not_empty, ticket);
+		finish_wait_condvar(&not_empty);
+		RB_STAT(__rb_stats()->stall_cycles += rdtsc() - start);
+		if (ring) break;
+	}
+	return ring;
+}
+
+static int init_shards(int nr_slots)
+{
+	if (nr_slots < 2) return -EINVAL;	/* Each shard is an lfring */
+
+	nr_shards = nr_generators;
+	nr_producers = nr_consumers = 0;
+
+	shards = aligned_alloc(CACHELINE_SIZE, sizeof(*shards) * nr_shards);
+	if (!shards) return -ENOMEM;
+
+	for (int i = 0; i < nr_shards; i++) {
+		int *slots = alloc_placed((size_t)record_size * nr_slots);
+
+		if (!slots) return -ENOMEM;
+		init_condvar(&shards[i].not_full);
+		if (init_lfring(&shards[i].ring, slots, nr_slots,
+					&shards[i].not_full, &not_empty)) return -ENOMEM;
+	}
+	return 0;
+}
+
+static void fini_shards(void)
+{
+	for (int i = 0; i < nr_shards; i++) {
+		free(shards[i].ring.slots);
+		fini_lfring(&shards[i].ring);
+	}
+	free(shards);
+	shards = NULL;
+}
+
+static void __init_ringbuffer_lock(union rb_lock *lock)
+{
+	if (ringbuffer.type == lock_spinlock) {
+		init_spinlock(&lock->spl);
+	} else if (ringbuffer.type == lock_mutex) {
+		init_mutex(&lock->mtl);
+	} else if (ringbuffer.type == lock_ticket) {
+		init_ticketlock(&lock->tkl);
+	} else if (ringbuffer.type == lock_mcs) {
+		init_mcslock(&lock->mcl);
+	} else if (ringbuffer.type == lock_adaptive) {
+		init_adaptive_mutex(&lock->aml);
+	} else if (ringbuffer.type == lock_elided) {
+		init_elided_spinlock(&lock->esl);
+	} else if (ringbuffer.type == lock_yield) {
+		init_yield_spinlock(&lock->ysl);
+	} else if (ringbuffer.type == lock_pi) {
+		init_pi_mutex(&lock->pml, true);
+	} else if (ringbuffer.type == lock_semaphore) {
+		init_sem(&lock->sem, 1);
+	}
+}
+
+static inline void __lock_ringbuffer(union rb_lock *lock)
+{
+	if (ringbuffer.type == lock_spinlock) {
+		acquire_spinlock(&lock->spl);
+	} else if (ringbuffer.type == lock_mutex) {
+		acquire_mutex(&lock->mtl);
+	} else if (ringbuffer.type == lock_ticket) {
+		acquire_ticketlock(&lock->tkl);
+	} else if (ringbuffer.type == lock_mcs) {
+		acquire_mcslock(&lock->mcl);
+	} else if (ringbuffer.type == lock_adaptive) {
+		acquire_adaptive_mutex(&lock->aml);
+	} else if (ringbuffer.type == lock_elided) {
+		acquire_elided_spinlock(&lock->esl);
+	} else if (ringbuffer.type == lock_yield) {
+		acquire_yield_spinlock(&lock->ysl);
+	} else if (ringbuffer.type == lock_pi) {
+		acquire_pi_mutex(&lock->pml);
+	} else if (ringbuffer.type == lock_semaphore) {
+		wait_sem(&lock->sem);
+	}
+}
+
+static inline void __unlock_ringbuffer(union rb_lock *lock)
+{
+	if (ringbuffer.type == lock_spinlock) {
+		release_spinlock(&lock->spl);
+	} else if (ringbuffer.type == lock_mutex) {
+		release_mutex(&lock->mtl);
+	} else if (ringbuffer.type == lock_ticket) {
+		release_ticketlock(&lock->tkl);
+	} else if (ringbuffer.type == lock_mcs) {
+		release_mcslock(&lock->mcl);
+	} else if (ringbuffer.type == lock_adaptive) {
+		release_adaptive_mutex(&lock->aml);
+	} else if (ringbuffer.type == lock_elided) {
+		release_elided_spinlock(&lock->esl);
+	} else if (ringbuffer.type == lock_yield) {
+		release_yield_spinlock(&lock->ysl);
+	} else if (ringbuffer.type == lock_pi) {
+		release_pi_mutex(&lock->pml);
+	} else if (ringbuffer.type == lock_semaphore) {
+		signal_sem(&lock->sem);
+	}
+}
+
+/*
+ * Drop @lock and sleep on @cv until the other side moves @pos away from
+ * @old, then take @lock again. The caller re-checks its condition.
+ */
+static void __wait_ringbuffer(union rb_lock *lock, struct condvar *cv,
+		unsigned long *pos, unsigned long old)
+{
+	int ticket = prepare_to_wait_condvar(cv);
+	RB_STAT(unsigned long start = rdtsc());
+
+	if (READ_ONCE(*pos) == old) {
+		__unlock_ringbuffer(lock);
+		wait_condvar(cv, ticket);
+		__lock_ringbuffer(lock);
+	}
+	finish_wait_condvar(cv);
+	RB_STAT(__rb_stats()->stall_cycles += rdtsc() - start);
+}
+
+/*
+ * The span a thread is working on between reserve and commit (or peek and
+ * release). @ring is set for the lock-free modes only.
+ */
+struct rb_span {
+	struct lfring *ring;
+	unsigned long pos;
+	int pad;		/* Padding in front of a reserved span */
+	int nr;
+#ifdef CONFIG_RB_STATS
+	unsigned long tsc;	/* When the span was requested, then taken */
+#endif
 };
+
+/* Account the wait for @span, and start its hold time */
+static inline void __span_taken(struct rb_span *span)
+{
+	RB_STAT(unsigned long now = rdtsc());
+	RB_STAT(__rb_stats()->nr_acquires++);
+	RB_STAT(__rb_stats()->wait_cycles += now - span->tsc);
+	RB_STAT(span->tsc = now);
+}
+
+static inline void __span_done(struct rb_span *span)
+{
+	RB_STAT(__rb_stats()->hold_cycles += rdtsc() - span->tsc);
+}
+
+static __thread struct rb_span my_reserved;
+static __thread struct rb_span my_peeked;
+
 /*********************************************************************
- * init_mutex(@mutex)
+ * reserve_ringbuffer(@min, @nr, @reserved)
  *
  * DESCRIPTION
- *   Initialize the mutex instance pointed by @mutex.
+ *   Reserve at least @min and up to @nr consecutive free slots for the
+ *   caller to fill in place with records of @record_size bytes, sleeping
+ *   until @min slots are free. The span never wraps around the end of the
+ *   buffer. If fewer than @min slots are left before the wrap, they become
+ *   padding that consumers skip, and the span starts over from the first
+ *   slot. So a producer asks for @min == @nr to get exactly @nr slots, or
+ *   for @min == 1 to take whatever is free. @min must not exceed @nr or
+ *   the buffer size. The number of reserved slots is stored in @reserved.
+ *   The reservation must be published with commit_ringbuffer() before the
+ *   next reservation; in the locked modes other producers wait until then.
+ *
+ *   In lock_semaphore mode @slots_free counts the free slots, so producers
+ *   sleep in wait_sem() rather than checking the buffer.
+ *
+ * RETURN
+ *   The first reserved slot.
  */
-void init_mutex(struct mutex *mutex)
+void *reserve_ringbuffer(int min, int nr, int *reserved)
 {
-	//init_sem(&mutex->sem,1);
-	//caller = malloc(sizeof(struct thread)*1);
-	//INIT_LIST_HEAD(&caller->list);	
-	init_spinlock(&mutex->spl);
-	//mutex->owner = NULL;
-	mutex->held = 0;
+	struct rb_segment *seg;
+	unsigned long tail, room;
+	int pad, max;
 
-	INIT_LIST_HEAD(&mutex->waitqueue);
+	assert(min > 0 && min <= nr && min <= ringbuffer.nr_slots);
+	RB_STAT(my_reserved.tsc = rdtsc());
+	if (ringbuffer.type == lock_lockfree) {
+		my_reserved.ring = &lfring;
+		my_reserved.nr = lfring_reserve(&lfring, min, nr, &my_reserved.pos,
+				&my_reserved.pad, true);
+	} else if (ringbuffer.type == lock_sharded) {
+		my_reserved.ring = __sharded_reserve(min, nr, &my_reserved.pos,
+				&my_reserved.pad, &my_reserved.nr);
+	}
+	if (my_reserved.ring) {
+		__span_taken(&my_reserved);
+		*reserved = my_reserved.nr;
+		return __slot(my_reserved.ring->slots, my_reserved.ring->nr_slots, my_reserved.pos);
+	}
 
-	sigemptyset(&set);
-	sigaddset(&set,SIGUSR1);
+	__lock_ringbuffer(&ringbuffer.producer);
+	if (ringbuffer_max_slots) __rb_try_shrink();
+	seg = ringbuffer.fill;
+	tail = ringbuffer.tail;
+	pad = __seg_pad(seg, tail, min);
+	max = __seg_contig(seg, tail + pad, nr);	/* Up to the wrap */
 
-	//sigemptyset(&release_set);	
-	//sigaddset(&release_set,SIGUSR2);
+	if (ringbuffer.type == lock_semaphore) {
+		for (int i = 0; i < pad + min; i++) {
+			if (try_wait_sem(&slots_free)) continue;
+			RB_STAT(unsigned long start = rdtsc());
+			RB_STAT(__rb_stats()->nr_full++);
+			wait_sem(&slots_free);
+			RB_STAT(__rb_stats()->stall_cycles += rdtsc() - start);
+		}
+		nr = min;
+		while (nr < max && try_wait_sem(&slots_free)) nr++;
+		goto out;
+	}
 
+	for (;;) {
+		room = seg->nr_slots - __seg_used(seg, tail, ringbuffer.cached_head);
+		if (room >= pad + min) break;
 
-	signal(SIGUSR1,signal_handler);		//when release alarm
-	
-	return;
+		/* Looks full. Refresh the consumers' index, then grow or wait */
+		ringbuffer.cached_head = smp_load_acquire(&ringbuffer.head);
+		if (seg->nr_slots - __seg_used(seg, tail, ringbuffer.cached_head) >= pad + min) continue;
+		if (ringbuffer_max_slots && __rb_try_grow()) {
+			seg = ringbuffer.fill;
+			pad = __seg_pad(seg, tail, min);
+			max = __seg_contig(seg, tail + pad, nr);
+			continue;
+		}
+		RB_STAT(__rb_stats()->nr_full++);
+		if (ringbuffer_max_slots) {
+			struct timespec start;
+
+			clock_gettime(CLOCK_MONOTONIC, &start);
+			__wait_ringbuffer(&ringbuffer.producer, &not_full,
+					&ringbuffer.head, ringbuffer.cached_head);
+			ringbuffer.stall_ns += __elapsed_ns(&start);
+		} else {
+			__wait_ringbuffer(&ringbuffer.producer, &not_full,
+					&ringbuffer.head, ringbuffer.cached_head);
+		}
+
+		/* Other producers may have moved on, even to a new segment */
+		seg = ringbuffer.fill;
+		tail = ringbuffer.tail;
+		pad = __seg_pad(seg, tail, min);
+		max = __seg_contig(seg, tail + pad, nr);
+	}
+	room -= pad;
+	nr = max < room ? max : room;
+out:
+	if (pad) WRITE_ONCE(seg->pad_at, tail);	/* Published by the commit */
+	__span_taken(&my_reserved);
+	my_reserved.pad = pad;
+	my_reserved.nr = *reserved = nr;
+	return __seg_slot(seg, tail + pad);
 }
 
+
 /*********************************************************************
- * acquire_mutex(@mutex)
+ * commit_ringbuffer()
  *
  * DESCRIPTION
- *   Acquire the mutex instance @mutex. Likewise acquire_spinlock(), you
- *   should not return from this function until the calling thread gets the
- *   mutex instance. But the calling thread should be put into sleep when
- *   the mutex is acquired by other threads.
- *
- * HINT
- *   1. Use sigwaitinfo(), sigemptyset(), sigaddset(), sigprocmask() to
- *      put threads into sleep until the mutex holder wakes up
- *   2. Use pthread_self() to get the pthread_t instance of the calling thread.
- *   3. Manage the threads that are waiting for the mutex instance using
- *      a custom data structure containing the pthread_t and list_head.
- *      However, you may need to use a spinlock to prevent the race condition
- *      on the waiter list (i.e., multiple waiters are being inserted into the 
- *      waiting list simultaneously, one waiters are going into the waiter list
- *      and the mutex holder tries to remove a waiter from the list, etc..)
+ *   Publish the slots reserved by the last reserve_ringbuffer() to the
+ *   consumers, along with the padding in front of them.
  */
-void acquire_mutex(struct mutex *mutex)     //acquire에서는 critical section 중요
+void commit_ringbuffer(void)
 {
-	
+	int nr = my_reserved.pad + my_reserved.nr;
 
-	acquire_spinlock(&mutex->spl);      //spinlock으로 막아줌
-	if(mutex->held == 1)       //lock의 주인이 있을 경우
-	{
-		//sigprocmask(SIG_BLOCK,&set,NULL);
-		caller = malloc(sizeof(struct thread)*1); 	    //caller
-		INIT_LIST_HEAD(&caller->list);      //caller 초기화
-		caller->pthread = pthread_self();       //caller의 thread id 저장
+	__span_done(&my_reserved);
+	if (my_reserved.ring) {
+		lfring_commit(my_reserved.ring, my_reserved.pos, my_reserved.pad, my_reserved.nr);
+		my_reserved.ring = NULL;
+		return;
+	}
 
-		//acquire_spinlock(&mutex->spl);
-		list_add_tail(&caller->list,&mutex->waitqueue);		    //waitqueue (FCFS이므로 add tail)
-		release_spinlock(&mutex->spl);			//release 
+	smp_store_release(&ringbuffer.tail, ringbuffer.tail + nr);
+	__unlock_ringbuffer(&ringbuffer.producer);
 
-		//sigprocmask(SIG_UNBLOCK,&set,NULL);
-		//pause();
-		sigwaitinfo(&set,NULL);         //SIGUSR1들어오면 풀림 (sleep until mutex holder wake up)
+	if (ringbuffer.type == lock_semaphore) {
+		for (int i = 0; i < nr; i++) signal_sem(&slots_filled);
+	} else {
+		__wake_up(&not_empty, nr);
 	}
-	else
-	{
-		mutex->held = 1;	        //held = 1
-		release_spinlock(&mutex->spl);          //release
+}
+
+
+/*********************************************************************
+ * peek_ringbuffer(@min, @max, @nr)
+ *
+ * DESCRIPTION
+ *   Take at least @min and up to @max consecutive filled slots for the
+ *   caller to process in place, sleeping until @min values are available.
+ *   The span never wraps around and never covers padding, so it stops
+ *   short of @min only where the run of filled slots ends at the wrap, at
+ *   padding, or where the buffer moved on to a new segment; producers that
+ *   reserve with the same @min never leave such a run. @min must not
+ *   exceed @max or the buffer size. The number of slots taken is stored
+ *   in @nr. The slots stay valid until release_ringbuffer().
+ *
+ * RETURN
+ *   The first slot taken.
+ */
+const void *peek_ringbuffer(int min, int max, int *nr)
+{
+	struct rb_segment *seg;
+	unsigned long head, tail, filled, end;
+	int contig;
+
+	assert(min > 0 && min <= max && min <= ringbuffer.nr_slots);
+	RB_STAT(my_peeked.tsc = rdtsc());
+	if (ringbuffer.type == lock_lockfree) {
+		my_peeked.ring = &lfring;
+		my_peeked.nr = lfring_peek(&lfring, min, max, &my_peeked.pos, true);
+	} else if (ringbuffer.type == lock_sharded) {
+		my_peeked.ring = __sharded_peek(min, max, &my_peeked.pos, &my_peeked.nr);
 	}
-	return;	
-	
-/**********************************
-use semaphore
-***********************************/
-	//wait_sem(&mutex->sem);
-	//return ;
-	/*
-	//signal(SIGUSR2,signal_release_handler);
-	caller->pthread = pthread_self();
-	//sigprocmask(SIG_BLOCK,&release_set,NULL);
-	//printf("mutex owner's thread id : %ld\n",mutex->owner->pthread);
-
-	//printf("caller thread id (acquire) : %ld\n",caller->pthread);
-	
-	
-	//sigprocmask(SIG_BLOCK,&set,NULL);
-	//list_add_tail(&caller->list,&mutex->waitqueue);
-	//while(compare_and_swap(&mutex->held,0,1));	//escape this line -> mutex holder wakes up!!!!!
-	
-	//sigprocmask(SIG_UNBLOCK,&set,NULL);
-	
-	if(mutex->owner== NULL){		//progress
-		while(compare_and_swap(&mutex->held,0,1));
-		mutex->owner = caller;
-		//list_first_entry(&mutex->waitqueue,struct thread,list);
-		//printf("mutex owner's thread id : %ld\n",mutex->owner->pthread);
-		return ;
-		
+	if (my_peeked.ring) {
+		__span_taken(&my_peeked);
+		*nr = my_peeked.nr;
+		return __slot(my_peeked.ring->slots, my_peeked.ring->nr_slots, my_peeked.pos);
 	}
-	
-	//printf("mutex owner's thread id : %ld\n",mutex->owner->pthread);
-	if(!list_empty(&mutex->waitqueue)){
-		struct thread * cursor = NULL;
-		struct thread * save = NULL;
-		list_for_each_entry_safe(cursor,save,&mutex->waitqueue,list){
-			//printf("wait thread id (waitqueue) : %ld\n",cursor->pthread);
-			cnt++;
-			if(cursor->pthread == caller->pthread || cursor->pthread == mutex->owner->pthread){
-				check = true;
-				//printf("wait thread id (waitqueue) : %ld\n",cursor->pthread);
-				return;
+
+	__lock_ringbuffer(&ringbuffer.consumer);
+	head = ringbuffer.head;
+	seg = __rb_drain_segment(head);
+
+	if (ringbuffer.type == lock_semaphore) {
+		for (;;) {
+			if (!try_wait_sem(&slots_filled)) {
+				RB_STAT(unsigned long start = rdtsc());
+				RB_STAT(__rb_stats()->nr_empty++);
+				wait_sem(&slots_filled);
+				RB_STAT(__rb_stats()->stall_cycles += rdtsc() - start);
 			}
+			if (head != READ_ONCE(seg->pad_at)) break;
+
+			/* The whole padding is in, as it is published with a run */
+			contig = __seg_contig(seg, head, seg->nr_slots);
+			for (int i = 1; i < contig; i++) wait_sem(&slots_filled);
+			head = __rb_skip_pad(seg, head);
 		}
+		contig = __seg_run(seg, head, max);
+		for (max = 1; max < min && max < contig; max++) wait_sem(&slots_filled);
+		while (max < contig && try_wait_sem(&slots_filled)) max++;
+
+		/* Padding may have shown up in the run while we waited */
+		for (contig = __seg_run(seg, head, max); max > contig; max--) {
+			signal_sem(&slots_filled);
+		}
+		goto out;
 	}
-	
-	if(!check){
-		//pthread_kill(mutex->owner->pthread,SIGUSR2);
-		
-		list_add_tail(&caller->list,&mutex->waitqueue);
-		
-	}
-	do{
-		while(sigwaitinfo(&set,NULL) != SIGUSR1);		
-		while(compare_and_swap(&mutex->held,0,1));
-		mutex->held=1;
-		return ;
-			
-	}while(1);
-	
-	/*sigprocmask(SIG_BLOCK,&set,NULL);
-	//list_add_tail(&caller->list,&mutex->waitqueue);
-	
-	sigprocmask(SIG_UNBLOCK,&set,NULL);
-	//list_add_tail(&caller->list,&mutex->waitqueue);
-	
-	int sigw = sigwaitinfo(&set,NULL);			//wait for unlock...
-	//printf("sigwait result! : %d\n",sigw);
-	//printf("release thread id : %ld\n",caller->pthread);
-	//printf("mutex owner's thread id : %ld\n",mutex->owner->pthread);
-	mutex->held=1;*/
-	
-	
-	//list_add_tail(&caller->list,&mutex->waitqueue);
-	
-	//while(compare_and_swap(&mutex->held,0,1));
-	
-	
-	/*sigprocmask(SIG_BLOCK,&set,NULL);	
-	
-	while(compare_and_swap(&mutex->held,0,1));	//escape this line -> mutex holder wakes up!!!!!
-	
-	printf("pthread_id after spinlock : %ld\n",pthread_self());
-	sigprocmask(SIG_UNBLOCK,&set,NULL);
-*/
-	/*if(sigwaitinfo(&set,NULL) == -1)		//when alarm on -> 
-	{
-		printf("Error !!!\n");
-	}*/
-
-/*		
-	if(list_empty(&mutex->waitqueue) && mutex->owner == NULL){
-		mutex->owner = caller;
-		mutex->held = 1;
-		return ;
+
+	for (;;) {
+		seg = __rb_drain_segment(head);
+
+		/* Positions from @end on are in the next segment */
+		end = ringbuffer.cached_tail;
+		if (smp_load_acquire(&seg->next) && seg->end < end) end = seg->end;
+		filled = end - head;
+		if (filled && head == READ_ONCE(seg->pad_at)) {
+			head = __rb_skip_pad(seg, head);
+			continue;
+		}
+		contig = __seg_run(seg, head, max);
+		if (filled >= min || (filled && (filled >= contig || end == seg->end))) break;
+
+		/* Not enough yet. Refresh the producers' index, then wait */
+		tail = smp_load_acquire(&ringbuffer.tail);
+		if (tail != ringbuffer.cached_tail) {
+			ringbuffer.cached_tail = tail;
+			continue;
+		}
+		RB_STAT(__rb_stats()->nr_empty++);
+		__wait_ringbuffer(&ringbuffer.consumer, &not_empty,
+				&ringbuffer.tail, ringbuffer.cached_tail);
+
+		/* Other consumers may have moved on while we slept */
+		head = ringbuffer.head;
 	}
-	
-	if(caller != mutex->owner){		//caller is different mutex's owner... race condition!!! 
-		list_add_tail(&caller->list,&mutex->waitqueue);
-		sigemptyset(&set);
-		sigaddset(&set,SIGUSR1);	
-		signal(SIGUSR1,signal_handler);		//when release alarm
-		sigprocmask(SIG_BLOCK,&set,NULL);
-		if(sigwaitinfo(&set,NULL) == -1)		//when alarm on -> 
-		{
-			fprintf(stderr,"Error !!!\n");
-		}
-		//critical section start
-		while(compare_and_swap(&mutex->held,0,1));	//escape this line -> mutex holder wakes up!!!!!
-		struct thread *next = list_first_entry(&mutex->waitqueue,struct thread,list);
-		mutex->owner = next;
-		//critical section end
-			
-	}*/
-
-	/*
-	//printf("%ld\n",caller->pthread);
-	sigemptyset(&set);
-	sigaddset(&set,SIGALRM);	
-	signal(SIGALRM,signal_handler);		//when release alarm
-	//sigaction(SIGALRM,&sa,&old_sa);
-	//sigwaitinfo(&set,&info);
-
-	sigprocmask(SIG_BLOCK,&set,NULL); 	//to use sleep until the mutex holder wakes up...
-	
-	//critical section
-	list_add_tail(&caller->list,&mutex->waitqueue);
-	//critical section end
-	while(compare_and_swap(&mutex->held,0,1));	//escape this line -> mutex holder wakes up!!!!!
-	sigprocmask(SIG_UNBLOCK,&set,NULL);
-	//mutex->getthread.pthread = pthread_self();
-	struct thread *next = list_first_entry(&mutex->waitqueue,struct thread,list);
-	mutex->owner = next;
-	*/
-	//sigprocmask(SIG_UNBLOCK,&release_set,NULL);
-	
+	max = contig < filled ? contig : filled;
+out:
+	__span_taken(&my_peeked);
+	my_peeked.nr = *nr = max;
+	return __seg_slot(seg, head);
 }
 
 
 /*********************************************************************
- * release_mutex(@mutex)
+ * release_ringbuffer()
  *
  * DESCRIPTION
- *   Release the mutex held by the calling thread.
- *
- * HINT
- *   1. Use pthread_kill() to wake up a waiter thread
- *   2. Be careful to prevent race conditions while accessing the waiter list
+ *   Hand the slots taken by the last peek_ringbuffer() back to the
+ *   producers.
  */
+void release_ringbuffer(void)
+{
+	int nr = my_peeked.nr;
+
+	__span_done(&my_peeked);
+	if (my_peeked.ring) {
+		lfring_release(my_peeked.ring, my_peeked.pos, nr);
+		my_peeked.ring = NULL;
+		return;
+	}
+
+	smp_store_release(&ringbuffer.head, ringbuffer.head + nr);
+	__unlock_ringbuffer(&ringbuffer.consumer);
+
+	if (ringbuffer.type == lock_semaphore) {
+		for (int i = 0; i < nr; i++) signal_sem(&slots_free);
+	} else {
+		__wake_up(&not_full, nr);
+	}
+}
+
 
-void release_mutex(struct mutex *mutex)         //release
+/*********************************************************************
+ * enqueue_batch_into_ringbuffer(@records, @nr)
+ *
+ * DESCRIPTION
+ *   Put up to @nr records of @record_size bytes from @records into the
+ *   buffer with a single reservation. Sleep until at least one slot is
+ *   available.
+ *
+ * RETURN
+ *   The number of records put into the buffer, starting from the first.
+ */
+int enqueue_batch_into_ringbuffer(const void *records, int nr)
 {
-	
-	
-	if(!list_empty(&mutex->waitqueue))      //waitqueue가 비어있지 않다면
-	{
-		acquire_spinlock(&mutex->spl);      //spinlock으로 막아줌
-		next = list_first_entry(&mutex->waitqueue,struct thread,list);      //first come first serve이므로 first entry로 뽑아줌
-		list_del_init(&next->list);
-		
-		release_spinlock(&mutex->spl);          //critical section 최소화
-		   //이미 next는 저장되어 있기 때문에
-		while(1)
-		{
-			if(!(pthread_kill(next->pthread,SIGUSR1)))      //pthread_kill은 성공하면 0이 반환되기 때문
-			{
-				break;
-			}	
-		}
-		
-	}
-	else
-	{
-		
-		mutex->held = 0;
-		release_spinlock(&mutex->spl);
-		
-	}
-
-/******************************
-	use semaphore
-********************************/
-	//signal_sem(&mutex->sem);
-	
-	/*if(pthread_self() != mutex->owner->pthread){
-		fprintf(stderr,"error!\n");
-		return ;
-	}
-	//printf("release call thread!!!!!!!! :%ld\n",pthread_self());
-	//printf("checkpoint1!\n");
-	//int sigwaitnum = sigwaitinfo(&release_set,NULL);
-
-	if(list_empty(&mutex->waitqueue)){
-		//printf("waitqueue is empty!!\n");
-		list_del_init(&mutex->owner->list);
-		mutex->owner = NULL;
-		mutex->held = 0;
-		return ;
-	}
-	mutex->held=0;
-	//struct thread * cursor = NULL;
-	//struct thread * save = NULL;
-	//list_for_each_entry_safe(cursor,save,&mutex->waitqueue,list){
-			//printf("wait thread id (waitqueue) : %ld\n",cursor->pthread);
-	//	pthread_kill(cursor->pthread,SIGUSR1);
-	//}
-	next = list_first_entry(&mutex->waitqueue,struct thread,list);
-	
-	list_del_init(&next->list);
-		//printf("checkpoint2!\n");
-	
-		//printf("checkpoint3!\n");
-	
-		//printf("NEXT pthread_id : %ld\n",next->pthread);
-		
-		//list_del_init(&mutex->owner->list);
-	mutex->owner = next;
-	
-	//printf("checkpoint4!\n");
-	pthread_kill(mutex->owner->pthread,SIGUSR1);*/
-	return;
+	void *span = reserve_ringbuffer(1, nr, &nr);
+
+	memcpy(span, records, (size_t)record_size * nr);
+	commit_ringbuffer();
+	return nr;
 }
+
+
 /*********************************************************************
- * Ring buffer
- *********************************************************************/
-struct ringbuffer {
-	/** NEVER CHANGE @nr_slots AND @slots ****/
-	/**/ int nr_slots;                     /**/
-	/**/ int *slots;                       /**/
-	/*****************************************/
-	
-};
-//nr_slots is size of ring buffer
-//slots is location of ringbuffer
+ * dequeue_batch_from_ringbuffer(@records, @max)
+ *
+ * DESCRIPTION
+ *   Take out up to @max records from the buffer into @records with a
+ *   single peek. Sleep until at least one record is available.
+ *
+ * RETURN
+ *   The number of records taken out.
+ */
+int dequeue_batch_from_ringbuffer(void *records, int max)
+{
+	const void *span = peek_ringbuffer(1, max, &max);
 
-struct ringbuffer ringbuffer = {
-	
+	memcpy(records, span, (size_t)record_size * max);
+	release_ringbuffer();
+	return max;
+}
 
-	
-};
-static int in = 0;          
-static int out = 0;
-struct spinlock spl;        //ring buffer를 어떤 락으로 돌지 spinlock
-struct mutex mtl;           //mutex lock
-enum lock_types types;      //둘 중에 어떤 락인지
-int count = 0;	        //usable slot number
-/*
-void init_spinlock_ringbuffer(int nr_slots){
-	init_spinlock(&spl);
-	splring.nr_slots = nr_slots;
-	splring.slots = (int *)malloc(sizeof*/
 
 /*********************************************************************
  * enqueue_into_ringbuffer(@value)
  *
  * DESCRIPTION
  *   Generator in the framework tries to put @value into the buffer.
+ *   Only the value part of the record is written.
  */
 void enqueue_into_ringbuffer(int value)     //강의노트 그대로지만 약간의 수정
 {
-	
-loop:
-	if(types == lock_spinlock){
-		acquire_spinlock(&spl);
-	
-		int check = 0;
-	
-	//printf("check! : %d\n",check);
-		check = (in +1) % ringbuffer.nr_slots;
-		
-	//printf("check! : %d\n",check);
-		if(check == out){
-			release_spinlock(&spl);
-			goto loop;
-		}
-		else{
-			/*while(1){
-				release_spinlock(&spl);
-				acquire_spinlock(&spl);
-				check
-		
-		ringbuffer*/
-			//이 부분은 강노와 다름
-			in = (in +1) % (ringbuffer.nr_slots);       //이 부분이 먼저 옴. circular queue 구현 방법 차이 
-			ringbuffer.slots[in] = value;      //값 넣어줌
-			release_spinlock(&spl);
-
-			return ;
-		}
-	}
-	else if(types == lock_mutex){           //mutex도 lock 차이 다른것은 똑같음 하지만 count 값 도입해서 진행해봄
-		acquire_mutex(&mtl);
-	
-		int check2 = 0;
-	
-	//printf("check! : %d\n",check);
-		check2 = (in +1) % ringbuffer.nr_slots;
-		
-	//printf("check! : %d\n",check);
-		//if(check2 == in){
-		if(count == ringbuffer.nr_slots){
-			release_mutex(&mtl);
-			goto loop;
-		}
-		
-			/*while(1){
-				release_spinlock(&spl);
-				acquire_spinlock(&spl);
-				check
-		
-		ringbuffer*/
-		
-		in = (in +1) % (ringbuffer.nr_slots);
-		ringbuffer.slots[in] = value;
-		count++;
-		release_mutex(&mtl);
+	int nr;
 
-		return ;
-		
-	}
+	*(int *)reserve_ringbuffer(1, 1, &nr) = value;
+	commit_ringbuffer();
 }
 
 
@@ -587,33 +2385,11 @@ loop:
  */
 int dequeue_from_ringbuffer(void)       //dequeue
 {
+	int nr, value;
 
-loop2:
-	if(types == lock_spinlock){
-		acquire_spinlock(&spl);
-		if(in == out){
-			release_spinlock(&spl);
-			goto loop2;
-		}
-		else{
-			out = (out+1) % (ringbuffer.nr_slots);      //이 부분이 다름 원래는 다음 item을 먼저 뽑지만 circular queue 자료구조 활용 정도 차이
-			//out을 다음 인덱스가 아닌 여기까지 차있다고 알려주는 index
-			release_spinlock(&spl);
-			return ringbuffer.slots[out];
-		}
-	}
-	else if(types == lock_mutex){       //spinlock과 같지만 count값 도입 및 lock이 mutex
-		acquire_mutex(&mtl);
-		if(count ==0){
-			release_mutex(&mtl);
-			goto loop2;
-		}
-		out = (out+1) % (ringbuffer.nr_slots);
-		count--;
-		release_mutex(&mtl);
-		return ringbuffer.slots[out];
-		
-	}
+	value = *(const int *)peek_ringbuffer(1, 1, &nr);
+	release_ringbuffer();
+	return value;
 }
 
 
@@ -624,18 +2400,22 @@ loop2:
  *   Clean up your ring buffer.
  */
 void fini_ringbuffer(void)
-{	if(types == lock_spinlock){
-		acquire_spinlock(&spl);
-		free(ringbuffer.slots);
-		release_spinlock(&spl);
-		return ;
-	}
-	else if(types == lock_mutex){
-		acquire_mutex(&mtl);
-		free(ringbuffer.slots);
-		release_mutex(&mtl);
-		return ;
+{
+	if (ringbuffer.type == lock_lockfree) {
+		fini_lfring(&lfring);
+	} else if (ringbuffer.type == lock_sharded) {
+		fini_shards();
+	} else {
+		while (ringbuffer.drain) {
+			struct rb_segment *seg = ringbuffer.drain;
+
+			ringbuffer.drain = seg->next;
+			__free_rb_segment(seg);
+		}
+		ringbuffer.fill = NULL;
 	}
+	free(ringbuffer.slots);
+	RB_STAT(__fini_rb_stats());
 }
 
 /*********************************************************************
@@ -650,11 +2430,42 @@ void fini_ringbuffer(void)
  */
 int init_ringbuffer(const int nr_slots)
 {
-	count = nr_slots;       //count값 도입!
+	ringbuffer.type = ringbuffer_lock;
+	ringbuffer.tail = ringbuffer.cached_head = 0;
+	ringbuffer.head = ringbuffer.cached_tail = 0;
+	__init_ringbuffer_lock(&ringbuffer.producer);
+	__init_ringbuffer_lock(&ringbuffer.consumer);
+	init_condvar(&not_full);
+	init_condvar(&not_empty);
+	init_sem(&slots_free, nr_slots);
+	init_sem(&slots_filled, 0);
+
 	/** DO NOT MODIFY THOSE TWO LINES **************************/
 	/**/ ringbuffer.nr_slots = nr_slots;                     /**/
 	/**/ ringbuffer.slots = malloc(sizeof(int) * nr_slots);  /**/
 	/***********************************************************/
-	
+	/* Room for whole records, on pages of their own when placed */
+	if (record_size != sizeof(int) || memory_placed()) {
+		free(ringbuffer.slots);
+		ringbuffer.slots = alloc_placed((size_t)record_size * nr_slots);
+	}
+	if (!ringbuffer.slots) return -ENOMEM;
+
+	if (ringbuffer.type == lock_lockfree) {
+		return init_lfring(&lfring, ringbuffer.slots, nr_slots,
+				&not_full, &not_empty);
+	} else if (ringbuffer.type == lock_sharded) {
+		return init_shards(nr_slots);
+	}
+
+	ringbuffer.min_slots = nr_slots;
+	ringbuffer.stall_ns = 0;
+	ringbuffer.nr_reserves = ringbuffer.nr_low_periods = 0;
+	memset(&rb_resize_stats, 0, sizeof(rb_resize_stats));
+	rb_resize_stats.max_nr_slots = nr_slots;
+	rb_segment_bytes = 0;
+	ringbuffer.fill = ringbuffer.drain =
+			__alloc_rb_segment(nr_slots, 0, ringbuffer.slots);
+	if (!ringbuffer.fill) return -ENOMEM;
 	return 0;
 }
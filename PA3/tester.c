@@ -19,14 +19,18 @@
 #include <pthread.h>
 #include <assert.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <string.h>
+#include <time.h>
 
 #include "types.h"
 #include "locks.h"
+#include "atomic.h"
 
 #include <sys/time.h>
 #include <sys/resource.h>
 
-pthread_barrier_t barrier;
+struct barrier barrier;
 
 static void *testlock;
 static int testlock_held = 0;
@@ -44,7 +48,39 @@ static inline const char *__lock_type(void)
 		return "spinlock";
 	} else if (lock_type == lock_mutex) {
 		return "mutex";
+	} else if (lock_type == lock_ticket) {
+		return "ticket spinlock";
+	} else if (lock_type == lock_mcs) {
+		return "MCS spinlock";
+	} else if (lock_type == lock_adaptive) {
+		return "adaptive mutex";
+	} else if (lock_type == lock_rwlock) {
+		return "reader-writer lock";
+	} else if (lock_type == lock_seqlock) {
+		return "seqlock";
+	} else if (lock_type == lock_semaphore) {
+		return "binary semaphore";
+	} else if (lock_type == lock_elided) {
+		return "elided spinlock";
+	} else if (lock_type == lock_yield) {
+		return "yielding spinlock";
+	} else if (lock_type == lock_pi) {
+		return "priority-inheritance mutex";
 	}
+	return NULL;	/* Not a lock */
+}
+
+static inline bool __lock_is_blocking(void)
+{
+	return lock_type == lock_mutex || lock_type == lock_adaptive ||
+		   lock_type == lock_rwlock || lock_type == lock_semaphore ||
+		   lock_type == lock_pi;
+}
+
+static inline bool __lock_is_fifo(void)
+{
+	return lock_type == lock_mutex || lock_type == lock_ticket ||
+		   lock_type == lock_mcs || lock_type == lock_pi;
 }
 
 static inline void __lock(void)
@@ -53,6 +89,24 @@ static inline void __lock(void)
 		acquire_spinlock(testlock);
 	} else if (lock_type == lock_mutex) {
 		acquire_mutex(testlock);
+	} else if (lock_type == lock_ticket) {
+		acquire_ticketlock(testlock);
+	} else if (lock_type == lock_mcs) {
+		acquire_mcslock(testlock);
+	} else if (lock_type == lock_adaptive) {
+		acquire_adaptive_mutex(testlock);
+	} else if (lock_type == lock_rwlock) {
+		acquire_write_rwlock(testlock);
+	} else if (lock_type == lock_seqlock) {
+		write_seqlock(testlock);
+	} else if (lock_type == lock_semaphore) {
+		wait_sem(testlock);
+	} else if (lock_type == lock_elided) {
+		acquire_elided_spinlock(testlock);
+	} else if (lock_type == lock_yield) {
+		acquire_yield_spinlock(testlock);
+	} else if (lock_type == lock_pi) {
+		acquire_pi_mutex(testlock);
 	}
 }
 
@@ -62,6 +116,24 @@ static inline void __unlock(void)
 		release_spinlock(testlock);
 	} else if (lock_type == lock_mutex) {
 		release_mutex(testlock);
+	} else if (lock_type == lock_ticket) {
+		release_ticketlock(testlock);
+	} else if (lock_type == lock_mcs) {
+		release_mcslock(testlock);
+	} else if (lock_type == lock_adaptive) {
+		release_adaptive_mutex(testlock);
+	} else if (lock_type == lock_rwlock) {
+		release_write_rwlock(testlock);
+	} else if (lock_type == lock_seqlock) {
+		write_sequnlock(testlock);
+	} else if (lock_type == lock_semaphore) {
+		signal_sem(testlock);
+	} else if (lock_type == lock_elided) {
+		release_elided_spinlock(testlock);
+	} else if (lock_type == lock_yield) {
+		release_yield_spinlock(testlock);
+	} else if (lock_type == lock_pi) {
+		release_pi_mutex(testlock);
 	}
 }
 
@@ -71,6 +143,24 @@ static inline void __init_lock(void)
 		init_spinlock(testlock);
 	} else if (lock_type == lock_mutex) {
 		init_mutex(testlock);
+	} else if (lock_type == lock_ticket) {
+		init_ticketlock(testlock);
+	} else if (lock_type == lock_mcs) {
+		init_mcslock(testlock);
+	} else if (lock_type == lock_adaptive) {
+		init_adaptive_mutex(testlock);
+	} else if (lock_type == lock_rwlock) {
+		init_rwlock(testlock);
+	} else if (lock_type == lock_seqlock) {
+		init_seqlock(testlock);
+	} else if (lock_type == lock_semaphore) {
+		init_sem(testlock, 1);
+	} else if (lock_type == lock_elided) {
+		init_elided_spinlock(testlock);
+	} else if (lock_type == lock_yield) {
+		init_yield_spinlock(testlock);
+	} else if (lock_type == lock_pi) {
+		init_pi_mutex(testlock, true);
 	}
 }
 
@@ -83,7 +173,7 @@ static bool keep_testing = true;
 static void *test_thread(void *_arg_)
 {
 	long id = (long)_arg_;
-	pthread_barrier_wait(&barrier);
+	wait_barrier(&barrier, id);
 	
 	/* Doing test #1 to #4 */
 	while (keep_testing) {
@@ -104,7 +194,7 @@ static void *test_thread(void *_arg_)
 	}
 
 	/* Do test #5 */
-	pthread_barrier_wait(&barrier);
+	wait_barrier(&barrier, id);
 	
 	usleep(id * 10000);
 	__lock();
@@ -115,7 +205,7 @@ static void *test_thread(void *_arg_)
 	usleep((nr_testers - id) * 100000);
 	__unlock();
 
-	pthread_barrier_wait(&barrier);
+	wait_barrier(&barrier, id);
 	return 0;
 }
 
@@ -134,21 +224,130 @@ static bool is_busywaiting(void)
 	return usage.ru_utime.tv_sec > testing_duration_sec;
 }
 
+/*********************************************************
+ * Readers against writers torture for rwlock and seqlock.
+ * Writers keep filling @shared with one value per update, word by word.
+ * A reader seeing different values in one read observed a torn update.
+ */
+#define TORTURE_WORDS 16
+
+static volatile unsigned long shared[TORTURE_WORDS];
+static int nr_torn = 0;
+static int nr_readers_inside = 0;
+static int max_readers_inside = 0;
+static int nr_reads = 0;
+static int nr_writes = 0;
+
+static bool __torn(const unsigned long *words)
+{
+	for (int i = 1; i < TORTURE_WORDS; i++) {
+		if (words[i] != words[0]) return true;
+	}
+	return false;
+}
+
+static void *torture_reader(void *_arg_)
+{
+	unsigned long words[TORTURE_WORDS];
+	int reads = 0;
+
+	wait_barrier(&barrier, (long)_arg_);
+	while (READ_ONCE(keep_testing)) {
+		if (lock_type == lock_rwlock) {
+			int inside;
+
+			acquire_read_rwlock(testlock);
+			inside = fetch_and_add(&nr_readers_inside, 1) + 1;
+			if (inside > max_readers_inside) max_readers_inside = inside;
+			for (int i = 0; i < TORTURE_WORDS; i++) {
+				words[i] = shared[i];
+			}
+			fetch_and_add(&nr_readers_inside, -1);
+			release_read_rwlock(testlock);
+		} else {
+			int seq;
+			do {
+				seq = read_seqbegin(testlock);
+				for (int i = 0; i < TORTURE_WORDS; i++) {
+					words[i] = shared[i];
+				}
+			} while (read_seqretry(testlock, seq));
+		}
+		if (__torn(words)) fetch_and_add(&nr_torn, 1);
+		reads++;
+	}
+	fetch_and_add(&nr_reads, reads);
+	return 0;
+}
+
+static void *torture_writer(void *_arg_)
+{
+	unsigned long value = (unsigned long)_arg_ << 32;
+	int writes = 0;
+
+	wait_barrier(&barrier, (long)_arg_);
+	while (READ_ONCE(keep_testing)) {
+		__lock();
+		if (lock_type == lock_rwlock) {
+			assert(READ_ONCE(nr_readers_inside) == 0);
+		}
+		value++;
+		for (int i = 0; i < TORTURE_WORDS; i++) {
+			shared[i] = value;
+			if (i == TORTURE_WORDS / 2) sched_yield();	/* Widen the window */
+		}
+		__unlock();
+		writes++;
+		usleep(10);
+	}
+	fetch_and_add(&nr_writes, writes);
+	return 0;
+}
+
+static bool torture_readers_writers(int nr_readers, int nr_writers)
+{
+	pthread_t threads[nr_readers + nr_writers];
+
+	keep_testing = true;
+	init_barrier(&barrier, barrier_type, nr_readers + nr_writers + 1);
+	for (int i = 0; i < nr_readers; i++) {
+		pthread_create(threads + i, NULL, torture_reader, (void *)(long)i);
+	}
+	for (int i = 0; i < nr_writers; i++) {
+		pthread_create(threads + nr_readers + i, NULL, torture_writer,
+				(void *)(long)(nr_readers + i));
+	}
+	wait_barrier(&barrier, nr_readers + nr_writers);
+
+	for (int i = 0; i < testing_duration_sec; i++) {
+		sleep(1);
+		__print_message(".");
+	}
+	keep_testing = false;
+
+	for (int i = 0; i < nr_readers + nr_writers; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	fini_barrier(&barrier);
+	return nr_torn == 0;
+}
+
 void test_lock(enum lock_types _lock_type_)
 {
 	pthread_t tester[nr_testers];
-	pthread_barrier_init(&barrier, NULL, nr_testers + 1);
+	init_barrier(&barrier, barrier_type, nr_testers + 1);
 	int temp = 0;
 	lock_type = _lock_type_;
 	bool ret = false;
 
+	assert(__lock_type());
 	__print_message("0. Testing '%s'\n", __lock_type());
 
 	/**
 	 * We don't know the actual size of the locking primitive object here.
 	 * So, just allocate a big memory, and ask to initialize it as a lock ;-)
 	 */
-	testlock = malloc(4096);
+	testlock = aligned_alloc(CACHELINE_SIZE, 4096);
 	__init_lock();
 
 	/*********************************************************
@@ -165,7 +364,7 @@ void test_lock(enum lock_types _lock_type_)
 	for (int i = 0; i < nr_testers; i++) {
 		pthread_create(tester + i, NULL, test_thread, (void *)(long)i);
 	}
-	pthread_barrier_wait(&barrier); /* Wait until test threads are ready */
+	wait_barrier(&barrier, nr_testers); /* Wait until test threads are ready */
 
 	assert(testlock_held == 1);
 	testlock_held = 0;
@@ -185,6 +384,41 @@ void test_lock(enum lock_types _lock_type_)
 	}
 	__print_message("  [Done]\n");
 	fprintf(stderr, "   Performance: %.1f operations/sec\n", (float)nr_tested / testing_duration_sec);
+	if (lock_type == lock_adaptive) {
+		struct lock_stats stats;
+		unsigned long nr_slow;
+
+		get_adaptive_mutex_stats(testlock, &stats);
+		nr_slow = stats.nr_spin + stats.nr_parked;
+		fprintf(stderr, "   Acquisitions: %lu fast, %lu spin, %lu parked (spin budget %d)\n",
+				stats.nr_fast, stats.nr_spin, stats.nr_parked, adaptive_mutex_spins);
+		fprintf(stderr, "   Wait time: %lu.%06lu sec total, %lu ns per contended acquire\n",
+				stats.wait_ns / 1000000000, stats.wait_ns / 1000 % 1000000,
+				nr_slow ? stats.wait_ns / nr_slow : 0);
+	}
+	if (lock_type == lock_elided) {
+		struct elision_stats stats;
+
+		get_elided_spinlock_stats(testlock, &stats);
+		fprintf(stderr, "   Elision: %s, %lu fallbacks\n",
+				elision_supported() ? "RTM" : "not supported", stats.nr_fallback);
+		fprintf(stderr, "   Aborts: %lu lock busy, %lu conflict, %lu capacity, %lu other\n",
+				stats.nr_busy, stats.nr_conflict, stats.nr_capacity, stats.nr_other);
+	}
+	if (lock_type == lock_yield) {
+		struct yield_stats stats;
+
+		get_yield_spinlock_stats(testlock, &stats);
+		fprintf(stderr, "   Contended: %lu acquisitions, %lu yields\n",
+				stats.nr_contended, stats.nr_yields);
+	}
+	if (lock_type == lock_pi) {
+		struct pi_stats stats;
+
+		get_pi_mutex_stats(testlock, &stats);
+		fprintf(stderr, "   Contended: %lu acquisitions, %lu boosts\n",
+				stats.nr_contended, stats.nr_boosts);
+	}
 
 	/*********************************************************
 	 * Testing possible-race condition.
@@ -204,26 +438,525 @@ void test_lock(enum lock_types _lock_type_)
 	ret = is_busywaiting();
 	__print_message("             [Done]\n");
 	fprintf(stderr, "   Seem to be a %s lock\n", ret ? "busy-waiting" : "blocking");
-	assert((lock_type == lock_spinlock && ret == true) ||
-		   (lock_type == lock_mutex && ret == false));
+	/*
+	 * The yielding spinlock spins, then waits in sched_yield(), which shows
+	 * up as system time; it is neither
+	 */
+	if (lock_type != lock_yield) assert(ret == !__lock_is_blocking());
 
 	keep_testing = false;
 
 	__print_message("5. Analyze the lock waiting order...\n");
-	pthread_barrier_wait(&barrier);
+	wait_barrier(&barrier, nr_testers);
 
-	pthread_barrier_wait(&barrier);
+	wait_barrier(&barrier, nr_testers);
 	fprintf(stderr, "   Waiting %s\n", lock_in_order ? "in order" : "out of order");
 
 	for (int i = 0; i < nr_testers; i++) {
 		pthread_join(tester[i], NULL);
 	}
+	fini_barrier(&barrier);
 	assert(testlock_held == 0);
-	if (lock_type == lock_spinlock || (lock_type == lock_mutex && lock_in_order)) {
+
+	if (lock_type == lock_rwlock || lock_type == lock_seqlock) {
+		bool ok;
+
+		__print_message("6. Torture readers against writers");
+		fflush(stdout);
+		ok = torture_readers_writers(nr_testers, 2);
+		__print_message("  [Done]\n");
+		fprintf(stderr, "   %.1f reads/sec, %.1f writes/sec, %d torn reads\n",
+				(float)nr_reads / testing_duration_sec,
+				(float)nr_writes / testing_duration_sec, nr_torn);
+		if (lock_type == lock_rwlock) {
+			fprintf(stderr, "   Up to %d readers inside at once\n", max_readers_inside);
+		}
+		assert(ok && "readers observed a torn update");
+	}
+
+	if (!__lock_is_fifo() || lock_in_order) {
 		fprintf(stderr, "\n >>>> Congraturations! Your %s implementation looks great!! <<<<\n\n", __lock_type());
 	} else {
-		assert(0 && "wrong lock wait ordering for mutex");
+		assert(0 && "wrong lock wait ordering for a FIFO lock");
 	}
 
 	return;
 }
+
+
+/*************************************************
+ * Lock benchmark.
+ * Will be invoked if the program is run with -B
+ *
+ * For every lock, sweeps the number of threads from 1 to the number of
+ * CPUs, the critical section length, and the think time between
+ * acquisitions. Each thread records how long every acquisition takes
+ * into a log-bucketed histogram. Results are printed in CSV.
+ */
+#define HIST_SUB_BITS	5	/* 32 sub-buckets per power of two; < 3.2% error */
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_BUCKETS	(64 * HIST_SUB)
+
+struct histogram {
+	unsigned long nr;
+	unsigned long max;
+	unsigned long counts[HIST_BUCKETS];
+};
+
+static inline int __hist_index(unsigned long v)
+{
+	int shift;
+
+	if (v < HIST_SUB) return v;
+	shift = 63 - __builtin_clzl(v) - HIST_SUB_BITS;
+	return ((shift + 1) << HIST_SUB_BITS) + (v >> shift) - HIST_SUB;
+}
+
+/* The lowest value falling into bucket @index */
+static inline unsigned long __hist_value(int index)
+{
+	int shift;
+
+	if (index < HIST_SUB) return index;
+	shift = (index >> HIST_SUB_BITS) - 1;
+	return ((unsigned long)(index & (HIST_SUB - 1)) + HIST_SUB) << shift;
+}
+
+static inline void __hist_record(struct histogram *h, unsigned long v)
+{
+	h->counts[__hist_index(v)]++;
+	h->nr++;
+	if (v > h->max) h->max = v;
+}
+
+static void __hist_merge(struct histogram *to, const struct histogram *from)
+{
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		to->counts[i] += from->counts[i];
+	}
+	to->nr += from->nr;
+	if (from->max > to->max) to->max = from->max;
+}
+
+static unsigned long __hist_percentile(const struct histogram *h, double percentile)
+{
+	unsigned long target = (unsigned long)(h->nr * percentile / 100);
+	unsigned long seen = 0;
+
+	for (int i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->counts[i];
+		if (seen > target) return __hist_value(i);
+	}
+	return h->max;
+}
+
+static inline unsigned long __now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/* Burn the CPU for @ns nanoseconds */
+static inline void __spin_ns(unsigned long ns)
+{
+	unsigned long until;
+
+	if (!ns) return;
+	until = __now_ns() + ns;
+	while (__now_ns() < until) cpu_relax();
+}
+
+static int bench_duration_msec = 200;
+static const unsigned long bench_cs_ns[] = { 0, 100, 1000 };
+static const unsigned long bench_think_ns[] = { 0, 1000 };
+
+static unsigned long bench_cs;
+static unsigned long bench_think;
+static bool bench_running;
+static struct histogram *bench_hists;
+
+static void *bench_thread(void *_arg_)
+{
+	long id = (long)_arg_;
+	struct histogram *h = bench_hists + id;
+
+	wait_barrier(&barrier, id);
+	while (READ_ONCE(bench_running)) {
+		unsigned long start = __now_ns();
+
+		__lock();
+		__hist_record(h, __now_ns() - start);
+		__spin_ns(bench_cs);
+		__unlock();
+
+		__spin_ns(bench_think);
+	}
+	return 0;
+}
+
+/* Let @nr_threads threads hammer the lock and merge their histograms into @total */
+static void __bench_run(int nr_threads, struct histogram *total)
+{
+	pthread_t threads[nr_threads];
+	struct histogram *hists = calloc(nr_threads, sizeof(*hists));
+
+	assert(hists);
+	__init_lock();
+	bench_running = true;
+	bench_hists = hists;
+	init_barrier(&barrier, barrier_type, nr_threads + 1);
+
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_create(threads + i, NULL, bench_thread, (void *)(long)i);
+	}
+	wait_barrier(&barrier, nr_threads);
+	usleep(bench_duration_msec * 1000);
+	WRITE_ONCE(bench_running, false);
+
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+		__hist_merge(total, hists + i);
+	}
+	fini_barrier(&barrier);
+	free(hists);
+}
+
+static void __bench_one(int nr_threads)
+{
+	struct histogram *total = calloc(1, sizeof(*total));
+
+	assert(total);
+	__bench_run(nr_threads, total);
+
+	printf("%s,%d,%lu,%lu,%lu,%.1f,%lu,%lu,%lu,%lu\n",
+			__lock_type(), nr_threads, bench_cs, bench_think,
+			total->nr, (double)total->nr * 1000 / bench_duration_msec,
+			__hist_percentile(total, 50), __hist_percentile(total, 99),
+			__hist_percentile(total, 99.9), total->max);
+	fflush(stdout);
+	free(total);
+}
+
+void bench_locks(void)
+{
+	int nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	testlock = aligned_alloc(CACHELINE_SIZE, 4096);
+	assert(testlock);
+
+	printf("lock,threads,cs_ns,think_ns,acquisitions,ops_per_sec,"
+			"p50_ns,p99_ns,p99.9_ns,max_ns\n");
+
+	for (int type = 0; type < NR_LOCK_TYPES; type++) {
+		lock_type = type;
+		if (!__lock_type()) continue;
+
+		for (int nr_threads = 1; ; nr_threads *= 2) {
+			if (nr_threads > nr_cpus) nr_threads = nr_cpus;
+
+			for (int c = 0; c < sizeof(bench_cs_ns) / sizeof(*bench_cs_ns); c++) {
+				for (int t = 0; t < sizeof(bench_think_ns) / sizeof(*bench_think_ns); t++) {
+					bench_cs = bench_cs_ns[c];
+					bench_think = bench_think_ns[t];
+					__bench_one(nr_threads);
+				}
+			}
+			if (nr_threads == nr_cpus) break;
+		}
+	}
+	free(testlock);
+}
+
+
+/*************************************************
+ * Oversubscription benchmark.
+ * Will be invoked if the program is run with -O
+ *
+ * Runs OVERSUB_FACTOR threads per CPU on the plain and the yielding
+ * spinlock, so lock holders get preempted in their critical sections.
+ * Besides the throughput, reports the CPU time the process burnt during
+ * each run and how often the waiters yielded. Results are printed in CSV.
+ */
+#define OVERSUB_FACTOR	4
+
+static const enum lock_types oversub_lock_types[] = { lock_spinlock, lock_yield };
+
+static inline double __cpu_sec(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec +
+			(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+void bench_oversubscribed(void)
+{
+	int nr_threads = sysconf(_SC_NPROCESSORS_ONLN) * OVERSUB_FACTOR;
+
+	testlock = aligned_alloc(CACHELINE_SIZE, 4096);
+	assert(testlock);
+
+	printf("lock,threads,cs_ns,acquisitions,ops_per_sec,cpu_sec,"
+			"ops_per_cpu_sec,yields\n");
+
+	for (int l = 0; l < sizeof(oversub_lock_types) / sizeof(*oversub_lock_types); l++) {
+		lock_type = oversub_lock_types[l];
+
+		for (int c = 0; c < sizeof(bench_cs_ns) / sizeof(*bench_cs_ns); c++) {
+			struct histogram *total = calloc(1, sizeof(*total));
+			unsigned long nr_yields = 0;
+			double cpu_sec;
+
+			assert(total);
+			bench_cs = bench_cs_ns[c];
+			bench_think = 0;
+
+			cpu_sec = __cpu_sec();
+			__bench_run(nr_threads, total);
+			cpu_sec = __cpu_sec() - cpu_sec;
+
+			if (lock_type == lock_yield) {
+				struct yield_stats stats;
+
+				get_yield_spinlock_stats(testlock, &stats);
+				nr_yields = stats.nr_yields;
+			}
+
+			printf("%s,%d,%lu,%lu,%.1f,%.3f,%.1f,%lu\n",
+					__lock_type(), nr_threads, bench_cs, total->nr,
+					(double)total->nr * 1000 / bench_duration_msec,
+					cpu_sec, cpu_sec > 0 ? total->nr / cpu_sec : 0, nr_yields);
+			fflush(stdout);
+			free(total);
+		}
+	}
+	free(testlock);
+}
+
+/*************************************************
+ * Barrier benchmark.
+ * Will be invoked if the program is run with -Y
+ *
+ * For every barrier type, sweeps the number of threads from 2 to 64.
+ * The threads are let go together through a latch and then meet at the
+ * barrier BENCH_EPISODES times back to back. Thread 0 records how long
+ * each episode takes into a histogram. Every thread also checks that
+ * nobody left an episode before everyone had arrived. Results are printed
+ * in CSV.
+ */
+#define BENCH_EPISODES		1000
+#define BENCH_MAX_THREADS	64
+
+static int bench_nr_threads;
+static int bench_nr_arrived;
+static struct latch bench_ready;
+static struct latch bench_start;
+
+static inline const char *__barrier_type(enum barrier_types type)
+{
+	if (type == barrier_pthread) {
+		return "pthread";
+	} else if (type == barrier_central) {
+		return "central";
+	} else if (type == barrier_tree) {
+		return "tree";
+	} else if (type == barrier_dissemination) {
+		return "dissemination";
+	}
+	return NULL;
+}
+
+static void *bench_barrier_thread(void *_arg_)
+{
+	long id = (long)_arg_;
+	unsigned long last;
+
+	count_down_latch(&bench_ready);
+	wait_latch(&bench_start);
+
+	last = __now_ns();
+	for (int i = 0; i < BENCH_EPISODES; i++) {
+		fetch_and_add(&bench_nr_arrived, 1);
+		wait_barrier(&barrier, id);
+		assert(READ_ONCE(bench_nr_arrived) >= (i + 1) * bench_nr_threads &&
+				"left the barrier before everyone arrived");
+
+		if (id == 0) {
+			unsigned long now = __now_ns();
+
+			__hist_record(bench_hists, now - last);
+			last = now;
+		}
+	}
+	return 0;
+}
+
+static void __bench_barrier_one(enum barrier_types type, int nr_threads)
+{
+	pthread_t threads[nr_threads];
+	struct histogram *h = calloc(1, sizeof(*h));
+	unsigned long start, elapsed;
+
+	assert(h);
+	bench_hists = h;
+	bench_nr_threads = nr_threads;
+	bench_nr_arrived = 0;
+	init_latch(&bench_ready, nr_threads);
+	init_latch(&bench_start, 1);
+	if (init_barrier(&barrier, type, nr_threads)) {
+		fprintf(stderr, "Cannot initialize %s barrier\n", __barrier_type(type));
+		exit(EXIT_FAILURE);
+	}
+
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_create(threads + i, NULL, bench_barrier_thread, (void *)(long)i);
+	}
+	wait_latch(&bench_ready);
+
+	start = __now_ns();
+	count_down_latch(&bench_start);
+	for (int i = 0; i < nr_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	elapsed = __now_ns() - start;
+	fini_barrier(&barrier);
+
+	printf("%s,%d,%d,%lu,%lu,%lu,%lu\n",
+			__barrier_type(type), nr_threads, BENCH_EPISODES,
+			elapsed / BENCH_EPISODES,
+			__hist_percentile(h, 50), __hist_percentile(h, 99), h->max);
+	fflush(stdout);
+	free(h);
+}
+
+void bench_barriers(void)
+{
+	printf("barrier,threads,episodes,ns_per_episode,p50_ns,p99_ns,max_ns\n");
+
+	for (int type = 0; type < NR_BARRIER_TYPES; type++) {
+		for (int nr_threads = 2; nr_threads <= BENCH_MAX_THREADS; nr_threads *= 2) {
+			__bench_barrier_one(type, nr_threads);
+		}
+	}
+}
+
+
+/*************************************************
+ * Priority inversion test.
+ * Will be invoked if the program is run with -I
+ *
+ * Sets up the classic inversion on one CPU. A low-priority thread takes
+ * the PI mutex and holds it for PI_HOLD_USEC. A high-priority thread then
+ * blocks on it while a medium-priority thread hogs the CPU for
+ * PI_HOG_USEC. Without inheritance the holder cannot run until the hog is
+ * done; with it, the holder runs at the high priority and lets the
+ * high-priority thread in after the hold time. Reports the worst and the
+ * average wait of the high-priority thread over PI_ROUNDS rounds each way.
+ */
+#define PI_ROUNDS	20
+#define PI_HOLD_USEC	1000
+#define PI_HOG_USEC	20000
+
+enum { PI_LOW, PI_MEDIUM, PI_HIGH, NR_PI_THREADS };
+static const int pi_prios[NR_PI_THREADS] = { 1, NR_PI_PRIOS / 2, NR_PI_PRIOS - 1 };
+
+static struct latch pi_held;
+static unsigned long pi_wait_usec[PI_ROUNDS];
+
+static void *pi_thread(void *_arg_)
+{
+	long id = (long)_arg_;
+
+	set_pi_priority(pi_prios[id]);
+
+	for (int round = 0; round < PI_ROUNDS; round++) {
+		wait_barrier(&barrier, id);
+
+		if (id == PI_LOW) {
+			acquire_pi_mutex(testlock);
+			count_down_latch(&pi_held);
+			__spin_ns(PI_HOLD_USEC * 1000UL);
+			release_pi_mutex(testlock);
+		} else if (id == PI_HIGH) {
+			unsigned long start;
+
+			wait_latch(&pi_held);
+			start = __now_ns();
+			acquire_pi_mutex(testlock);
+			pi_wait_usec[round] = (__now_ns() - start) / 1000;
+			release_pi_mutex(testlock);
+		} else {
+			wait_latch(&pi_held);
+			__spin_ns(PI_HOG_USEC * 1000UL);
+		}
+
+		wait_barrier(&barrier, id);
+	}
+	return 0;
+}
+
+static void __run_priority_inversion(bool inherit)
+{
+	pthread_t threads[NR_PI_THREADS];
+	pthread_attr_t attr;
+	cpu_set_t cpus;
+	struct pi_stats stats;
+	unsigned long worst = 0, total = 0;
+
+	/* Everyone on the CPU we run on, so that the hog starves the holder */
+	CPU_ZERO(&cpus);
+	CPU_SET(sched_getcpu(), &cpus);
+	pthread_attr_init(&attr);
+	pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+
+	init_pi_mutex(testlock, inherit);
+	init_barrier(&barrier, barrier_type, NR_PI_THREADS + 1);
+	for (int i = 0; i < NR_PI_THREADS; i++) {
+		pthread_create(threads + i, &attr, pi_thread, (void *)(long)i);
+	}
+	pthread_attr_destroy(&attr);
+
+	for (int round = 0; round < PI_ROUNDS; round++) {
+		init_latch(&pi_held, 1);
+		wait_barrier(&barrier, NR_PI_THREADS);
+		wait_barrier(&barrier, NR_PI_THREADS);
+	}
+	for (int i = 0; i < NR_PI_THREADS; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	fini_barrier(&barrier);
+
+	for (int round = 0; round < PI_ROUNDS; round++) {
+		total += pi_wait_usec[round];
+		if (pi_wait_usec[round] > worst) worst = pi_wait_usec[round];
+	}
+	get_pi_mutex_stats(testlock, &stats);
+	fprintf(stderr, "   %s inheritance: worst %lu usec, average %lu usec, %lu boosts\n",
+			inherit ? "With" : "Without", worst, total / PI_ROUNDS, stats.nr_boosts);
+}
+
+void test_priority_inversion(void)
+{
+	static const char * const modes[] = {
+		[pi_simulated] = "simulated",
+		[pi_nice] = "nice",
+		[pi_fifo] = "SCHED_FIFO",
+	};
+
+	testlock = aligned_alloc(CACHELINE_SIZE, 4096);
+	assert(testlock);
+
+	__print_message("Priority inversion with %s priorities; holding %d usec against a %d usec hog\n",
+			modes[pi_mode()], PI_HOLD_USEC, PI_HOG_USEC);
+	if (pi_mode() == pi_simulated) {
+		fprintf(stderr, "   Cannot change thread priorities; the waits will look alike\n");
+	}
+
+	__run_priority_inversion(false);
+	__run_priority_inversion(true);
+
+	free(testlock);
+}
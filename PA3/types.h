@@ -30,16 +30,82 @@ enum lock_types {
 	lock_spinlock = 0,
 	lock_mutex = 1,
 	lock_semaphore = 2,
+	lock_lockfree = 3,
+	lock_ticket = 4,
+	lock_mcs = 5,
+	lock_adaptive = 6,
+	lock_sharded = 7,
+	lock_rwlock = 8,
+	lock_seqlock = 9,
+	lock_elided = 10,
+	lock_yield = 11,
+	lock_pi = 12,
+	NR_LOCK_TYPES,
 };
 
+extern enum lock_types ringbuffer_lock;
+
+/*
+ * Elastic ring buffer (-E). It may grow up to @ringbuffer_max_slots under
+ * pressure and shrink back to its initial size; 0 keeps the size fixed.
+ */
+extern int ringbuffer_max_slots;
+
+struct rb_resize_stats {
+	unsigned long nr_grows;
+	unsigned long nr_shrinks;
+	int nr_slots;			/* Size producers fill now */
+	int max_nr_slots;		/* Largest size reached */
+	unsigned long peak_bytes;	/* Most slot memory held at once */
+};
+
+void get_ringbuffer_resize_stats(struct rb_resize_stats *);
+
+#ifdef CONFIG_RB_STATS
+/* Ring buffer hot-path counters, summed over all threads */
+struct rb_stats {
+	unsigned long nr_acquires;	/* Spans reserved or peeked */
+	unsigned long nr_full;		/* Waits because the buffer was full */
+	unsigned long nr_empty;		/* Waits because the buffer was empty */
+	unsigned long nr_races;		/* Lost CAS races (lock-free modes) */
+	unsigned long wait_cycles;	/* Until a span is taken, stalls included */
+	unsigned long stall_cycles;	/* Asleep on full or empty */
+	unsigned long hold_cycles;	/* From taking a span to handing it over */
+};
+
+void get_ringbuffer_stats(struct rb_stats *);
+#endif
+
+#define CACHELINE_SIZE 64
+#define __cacheline_aligned __attribute__((aligned(CACHELINE_SIZE)))
+
+/* Default value range; -V changes it at runtime */
 #define MIN_VALUE 0
+#ifndef MAX_VALUE		/* make MAX_VALUE=n for wider histograms */
 #define MAX_VALUE 128
+#endif
+
+/* Values are in [min_value, max_value); histograms have one bucket each */
+extern int min_value;
+extern int max_value;
+
+/*
+ * Bytes per record moved through the ring buffer. A record starts with
+ * its value, and the rest is filled with the value's low byte.
+ */
+#define RECORD_MIN_SIZE 8
+#define RECORD_MAX_SIZE 4096
+extern int record_size;
 
 extern int nr_generators;
 extern unsigned long nr_generate;
 
+extern int batch_size;
+
+extern int nr_counters;
 extern int counter_delay_usec;
 extern int generator_delay_usec;
+extern bool generator_accumulate;
 
 #define __print_message(string, args...) \
 	if (verbose) { \